@@ -0,0 +1,525 @@
+#include "thread_pool.h"
+#include "metrics_exporter.h"
+#include "parallel_algorithms.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+#ifdef LAB2_PARALLEL_STL
+#include <execution>
+#endif
+
+using bench_clock = std::chrono::steady_clock;
+
+// an aged level brings its own worker that also steals young tasks, without levels
+// the workers of a row are all the threads running tasks
+static const std::vector<AgingLevel> no_aging{};
+
+struct BenchmarkOptions {
+    uint32_t max_workers = std::max(4u, std::thread::hardware_concurrency());
+    uint32_t throughput_tasks = 200000;
+    uint32_t latency_tasks = 5000;
+    uint32_t queue_elements = 100000;
+    uint32_t parallel_elements = 1 << 22;
+    uint32_t coroutine_tasks = 100000;
+    std::string output_path{};
+};
+
+class JsonResults {
+public:
+    void begin_result(const char *name) {
+        this->output << (this->results_num++ ? ",\n" : "") << "    {\"name\": \"" << name << "\"";
+    }
+
+    template <typename V>
+    void field(const char *key, V value) {
+        this->output << ", \"" << key << "\": ";
+
+        if constexpr (std::is_convertible_v<V, const char *>)
+            this->output << "\"" << value << "\"";
+        else
+            this->output << value;
+    }
+
+    void end_result() {
+        this->output << "}";
+    }
+
+    std::string str() const {
+        return "{\n  \"benchmark\": \"lab2\",\n  \"results\": [\n" + this->output.str() + "\n  ]\n}\n";
+    }
+
+private:
+    std::ostringstream output;
+    uint32_t results_num = 0;
+};
+
+static ThreadTask make_task(TaskFunction &&func, uint32_t id, std::chrono::milliseconds wait_time) {
+    return ThreadTask{std::move(func), id, Clock::now(), wait_time};
+}
+
+// a benchmark of a wrong result is worthless, the run fails instead
+static void verify(bool condition, const char *what) {
+    if (condition)
+        return;
+
+    fprintf(stderr, "Verification failed: %s\n", what);
+    std::exit(1);
+}
+
+static void wait_for_counter(const std::atomic<uint32_t> &counter, uint32_t expected) {
+    while (counter.load(std::memory_order_acquire) < expected)
+        std::this_thread::yield();
+}
+
+template <typename Pool>
+void bench_empty_task_throughput(JsonResults &results, const BenchmarkOptions &options, const char *queue_name,
+                                 uint32_t workers, YoungQueueMode queue_mode, bool bulk) {
+    std::atomic<uint32_t> completed{0};
+    Pool pool(workers, true, queue_mode, no_aging);
+
+    constexpr uint32_t batch_size = 256;
+
+    auto start = bench_clock::now();
+
+    if (bulk) {
+        std::vector<ThreadTask> batch;
+        for (uint32_t i = 0; i < options.throughput_tasks; i += batch_size) {
+            for (uint32_t j = i; j < std::min(i + batch_size, options.throughput_tasks); j++)
+                batch.push_back(make_task([&completed]() { completed.fetch_add(1, std::memory_order_release); },
+                                          j, std::chrono::milliseconds(j % 16)));
+
+            pool.add_tasks(batch.begin(), batch.end());
+            batch.clear();
+        }
+    } else {
+        for (uint32_t i = 0; i < options.throughput_tasks; i++) {
+            auto task = make_task([&completed]() { completed.fetch_add(1, std::memory_order_release); },
+                                  i, std::chrono::milliseconds(i % 16));
+
+            // a bounded queue refuses tasks while it is full and leaves them as they were
+            while (!pool.add_task(std::move(task)))
+                std::this_thread::yield();
+        }
+    }
+
+    wait_for_counter(completed, options.throughput_tasks);
+
+    std::chrono::duration<double> elapsed = bench_clock::now() - start;
+    auto telemetry = pool.get_telemetry().snapshot();
+
+    results.begin_result("empty_task_throughput");
+    results.field("queue", queue_name);
+    results.field("workers", workers);
+    results.field("queue_mode", queue_mode == YoungQueueMode::work_stealing ? "work_stealing" : "shared_queue");
+    results.field("submission", bulk ? "add_tasks" : "add_task");
+    results.field("tracing", Tracer::enabled() ? "on" : "off");
+    results.field("tasks", options.throughput_tasks);
+    results.field("seconds", elapsed.count());
+    results.field("tasks_per_second", options.throughput_tasks / elapsed.count());
+    results.field("tasks_stolen", telemetry.get_stolen_tasks());
+    results.field("allocator_hit_rate", telemetry.get_allocator_hit_rate());
+    results.end_result();
+}
+
+void bench_submit_to_start_latency(JsonResults &results, const BenchmarkOptions &options, uint32_t workers) {
+    std::atomic<uint32_t> completed{0};
+    LatencyHistogram latency{};
+    ThreadPool pool(workers, true, YoungQueueMode::work_stealing, no_aging);
+
+    for (uint32_t i = 0; i < options.latency_tasks; i++) {
+        auto submitted = bench_clock::now();
+
+        pool.add_task(make_task([&, submitted]() {
+            auto started = bench_clock::now();
+            latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(started - submitted).count());
+            completed.fetch_add(1, std::memory_order_release);
+        }, i, std::chrono::milliseconds(0)));
+
+        // spaced out, so this measures the path to an idle worker and not queueing
+        wait_for_counter(completed, i + 1);
+    }
+
+    HistogramSnapshot snapshot{};
+    latency.add_to(snapshot);
+
+    results.begin_result("submit_to_start_latency");
+    results.field("workers", workers);
+    results.field("tasks", options.latency_tasks);
+    results.field("p50_us", snapshot.percentile(0.5) / 1000);
+    results.field("p99_us", snapshot.percentile(0.99) / 1000);
+    results.field("p999_us", snapshot.percentile(0.999) / 1000);
+    results.end_result();
+}
+
+#ifdef LAB2_COROUTINES
+static PoolTask<> resume_on_pool(ThreadPool &pool, std::atomic<uint32_t> &resumed) {
+    co_await pool.schedule();
+    resumed.fetch_add(1, std::memory_order_relaxed);
+}
+
+static PoolTask<int> add_one_on_pool(ThreadPool &pool, int value) {
+    co_await pool.schedule();
+    co_return value + 1;
+}
+
+// every link suspends and resumes on some worker, none of them holds a thread while it is suspended
+static PoolTask<int> chain_on_pool(ThreadPool &pool, int length) {
+    int value = 0;
+    for (int i = 0; i < length; i++)
+        value = co_await add_one_on_pool(pool, value);
+
+    co_return value;
+}
+
+void bench_coroutines(JsonResults &results, const BenchmarkOptions &options, uint32_t workers) {
+    constexpr int chain_length = 1000;
+    constexpr uint32_t dropped_tasks = 16;
+
+    std::atomic<uint32_t> resumed{0};
+    double spawn_seconds, chain_seconds;
+
+    {
+        ThreadPool pool(workers, true, YoungQueueMode::work_stealing, no_aging);
+
+        std::vector<TaskFuture<void>> futures;
+        futures.reserve(options.coroutine_tasks);
+
+        auto start = bench_clock::now();
+        for (uint32_t i = 0; i < options.coroutine_tasks; i++)
+            futures.push_back(pool.spawn(resume_on_pool(pool, resumed)));
+
+        for (auto &future: futures)
+            future.get();
+        spawn_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+        verify(resumed == options.coroutine_tasks, "every spawned coroutine resumed on the pool");
+
+        start = bench_clock::now();
+        verify(pool.spawn(chain_on_pool(pool, chain_length)).get() == chain_length, "PoolTask<int> chain result");
+        chain_seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    }
+
+    // coroutines still queued when the pool goes away are resumed by their dropped task and fail their futures,
+    // ones offered to a terminated pool are refused and fail straight away
+    std::vector<TaskFuture<void>> dropped;
+    {
+        ThreadPool pool(workers, false, YoungQueueMode::work_stealing, no_aging);
+
+        for (uint32_t i = 0; i < dropped_tasks; i++)
+            dropped.push_back(pool.spawn(resume_on_pool(pool, resumed)));
+
+        pool.terminate();
+        dropped.push_back(pool.spawn(resume_on_pool(pool, resumed)));
+    }
+
+    uint32_t failed = 0;
+    for (auto &future: dropped) {
+        try {
+            future.get();
+        } catch (const std::exception &) {
+            failed++;
+        }
+    }
+
+    verify(failed == dropped_tasks + 1, "coroutines dropped or refused by the pool fail their futures");
+
+    results.begin_result("coroutines");
+    results.field("workers", workers);
+    results.field("spawned", options.coroutine_tasks);
+    results.field("spawn_per_second", options.coroutine_tasks / spawn_seconds);
+    results.field("chain_length", chain_length);
+    results.field("chain_hop_us", chain_seconds * 1e6 / chain_length);
+    results.end_result();
+}
+#endif
+
+struct QueueNode {
+    uint32_t priority;
+    IndexedHeapHook heap_hook{};
+    IntrusiveRefCount intrusive_hook{};
+};
+
+static bool queue_node_comparator(const IntrusivePtr<QueueNode> &a, const IntrusivePtr<QueueNode> &b) {
+    return a->priority > b->priority;
+}
+
+struct QueueNodeComparator {
+    bool operator()(const IntrusivePtr<QueueNode> &a, const IntrusivePtr<QueueNode> &b) const {
+        return a->priority > b->priority;
+    }
+};
+
+static double per_element(bench_clock::duration elapsed, uint32_t elements) {
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / elements;
+}
+
+template <typename Compare>
+void bench_indexed_queue(JsonResults &results, const std::vector<IntrusivePtr<QueueNode>> &nodes,
+                         const char *comparator_name, Compare comparator) {
+    IndexedPriorityQueue<QueueNode, Compare> queue{comparator};
+
+    auto push_start = bench_clock::now();
+    for (auto &node: nodes)
+        queue.push(node);
+    auto push_end = bench_clock::now();
+
+    IntrusivePtr<QueueNode> out_value;
+    while (queue.pop(out_value));
+    auto pop_end = bench_clock::now();
+
+    auto bulk_start = bench_clock::now();
+    queue.push_bulk(nodes.begin(), nodes.end());
+    auto bulk_end = bench_clock::now();
+    queue.clear();
+
+    results.begin_result("queue_push_pop");
+    results.field("queue", "IndexedPriorityQueue");
+    results.field("comparator", comparator_name);
+    results.field("elements", (uint32_t) nodes.size());
+    results.field("push_ns", per_element(push_end - push_start, nodes.size()));
+    results.field("pop_ns", per_element(pop_end - push_end, nodes.size()));
+    results.field("push_bulk_ns", per_element(bulk_end - bulk_start, nodes.size()));
+    results.end_result();
+}
+
+void bench_queue_push_pop(JsonResults &results, const BenchmarkOptions &options) {
+    std::default_random_engine generator(42);
+    std::uniform_int_distribution<uint32_t> priorities(0, 1000000);
+
+    std::vector<IntrusivePtr<QueueNode>> nodes;
+    nodes.reserve(options.queue_elements);
+    for (uint32_t i = 0; i < options.queue_elements; i++)
+        nodes.push_back(make_intrusive<QueueNode>(priorities(generator)));
+
+    bench_indexed_queue(results, nodes, "function_pointer", queue_node_comparator);
+    bench_indexed_queue(results, nodes, "function_object", QueueNodeComparator{});
+
+    PriorityQueue<ThreadTask> legacy_queue{[](const std::shared_ptr<ThreadTask> &a,
+                                              const std::shared_ptr<ThreadTask> &b) {
+        return a->wait_time > b->wait_time;
+    }};
+
+    std::vector<std::shared_ptr<ThreadTask>> tasks;
+    tasks.reserve(options.queue_elements);
+    for (auto &node: nodes)
+        tasks.push_back(std::make_shared<ThreadTask>(
+                make_task(TaskFunction{}, 0, std::chrono::milliseconds(node->priority))));
+
+    auto push_start = bench_clock::now();
+    for (auto &task: tasks)
+        legacy_queue.push(task);
+    auto push_end = bench_clock::now();
+
+    std::shared_ptr<ThreadTask> out_task;
+    while (legacy_queue.pop(out_task));
+    auto pop_end = bench_clock::now();
+
+    results.begin_result("queue_push_pop");
+    results.field("queue", "PriorityQueue");
+    results.field("elements", options.queue_elements);
+    results.field("push_ns", per_element(push_end - push_start, options.queue_elements));
+    results.field("pop_ns", per_element(pop_end - push_end, options.queue_elements));
+    results.end_result();
+}
+
+template <typename FT>
+static double measure_seconds(FT func) {
+    auto start = bench_clock::now();
+    func();
+
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void report_parallel(JsonResults &results, const char *algorithm, const char *implementation,
+                            uint32_t workers, uint32_t elements, double seconds, double serial_seconds) {
+    results.begin_result("parallel_algorithms");
+    results.field("algorithm", algorithm);
+    results.field("implementation", implementation);
+    results.field("workers", workers);
+    results.field("elements", elements);
+    results.field("seconds", seconds);
+    results.field("speedup", serial_seconds / seconds);
+    results.end_result();
+}
+
+void bench_parallel_algorithms(JsonResults &results, const BenchmarkOptions &options, uint32_t workers) {
+    ThreadPool pool(workers, true, YoungQueueMode::work_stealing, no_aging);
+    auto elements = options.parallel_elements;
+
+    std::default_random_engine generator(42);
+    std::uniform_real_distribution<double> distribution(0, 1);
+
+    std::vector<double> input(elements);
+    for (auto &value: input)
+        value = distribution(generator);
+
+    std::vector<double> output(elements);
+    auto transform = [&](size_t i) { output[i] = std::sqrt(input[i]) * std::log1p(input[i]); };
+
+    // the same arithmetic per element, so any order gives the serial result bit for bit
+    auto check_transformed = [&](const std::vector<double> &expected, const char *what) {
+        verify(output == expected, what);
+        std::fill(output.begin(), output.end(), 0.0);
+    };
+
+    // summed in another order, so only equal up to rounding
+    auto check_sum = [](double sum, double expected, const char *what) {
+        verify(std::abs(sum - expected) <= 1e-9 * std::abs(expected), what);
+    };
+
+    auto check_sorted = [&](const std::vector<double> &expected, const char *what) {
+        verify(std::is_sorted(output.begin(), output.end()) && output == expected, what);
+    };
+
+    auto serial_for = measure_seconds([&]() {
+        for (size_t i = 0; i < elements; i++)
+            transform(i);
+    });
+    report_parallel(results, "for", "serial", workers, elements, serial_for, serial_for);
+
+    auto transformed = output;
+    std::fill(output.begin(), output.end(), 0.0);
+
+    report_parallel(results, "for", "parallel_for", workers, elements, measure_seconds([&]() {
+        parallel_for(pool, size_t(0), size_t(elements), transform);
+    }), serial_for);
+    check_transformed(transformed, "parallel_for result");
+
+    double serial_sum, sum;
+    auto serial_reduce = measure_seconds([&]() { serial_sum = std::accumulate(input.begin(), input.end(), 0.0); });
+    report_parallel(results, "reduce", "serial", workers, elements, serial_reduce, serial_reduce);
+    report_parallel(results, "reduce", "parallel_reduce", workers, elements, measure_seconds([&]() {
+        sum = parallel_reduce(pool, size_t(0), size_t(elements), 0.0, [&](size_t i) { return input[i]; },
+                              std::plus<>{});
+    }), serial_reduce);
+    check_sum(sum, serial_sum, "parallel_reduce result");
+
+    output = input;
+    auto serial_sort = measure_seconds([&]() { std::sort(output.begin(), output.end()); });
+    report_parallel(results, "sort", "serial", workers, elements, serial_sort, serial_sort);
+
+    auto sorted = output;
+    output = input;
+
+    report_parallel(results, "sort", "parallel_sort", workers, elements, measure_seconds([&]() {
+        parallel_sort(pool, output.begin(), output.end());
+    }), serial_sort);
+    check_sorted(sorted, "parallel_sort result");
+
+#ifdef LAB2_PARALLEL_STL
+    // runs on TBB's own threads, workers does not apply to it
+    report_parallel(results, "for", "std_execution_par", workers, elements, measure_seconds([&]() {
+        std::for_each(std::execution::par, input.begin(), input.end(), [&](const double &value) {
+            transform(&value - input.data());
+        });
+    }), serial_for);
+    check_transformed(transformed, "std::for_each(par) result");
+
+    report_parallel(results, "reduce", "std_execution_par", workers, elements, measure_seconds([&]() {
+        sum = std::reduce(std::execution::par, input.begin(), input.end(), 0.0);
+    }), serial_reduce);
+    check_sum(sum, serial_sum, "std::reduce(par) result");
+
+    output = input;
+    report_parallel(results, "sort", "std_execution_par", workers, elements, measure_seconds([&]() {
+        std::sort(std::execution::par, output.begin(), output.end());
+    }), serial_sort);
+    check_sorted(sorted, "std::sort(par) result");
+#endif
+}
+
+BenchmarkOptions parse_options(int argc, char **argv) {
+    BenchmarkOptions options{};
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--quick")) {
+            options.throughput_tasks /= 10;
+            options.latency_tasks /= 10;
+            options.queue_elements /= 10;
+            options.parallel_elements /= 16;
+            options.coroutine_tasks /= 10;
+        } else if (!strcmp(argv[i], "--max-workers") && i + 1 < argc) {
+            options.max_workers = std::max(1, atoi(argv[++i]));
+        } else {
+            options.output_path = argv[i];
+        }
+    }
+
+    return options;
+}
+
+// usage: benchmark [--quick] [--max-workers N] [output.json]
+// le is inclusive, an observation right on a bound has to be counted in that bound and not in the one before
+static void check_histogram_bounds() {
+    struct BoundCase {
+        uint64_t value_us;
+        const char *le;
+        const char *previous_le;
+    };
+
+    for (auto bound: {BoundCase{1, "1e-06", nullptr}, BoundCase{2, "2e-06", "1e-06"}, BoundCase{4, "4e-06", "2e-06"},
+                      BoundCase{7, "7e-06", "4e-06"}, BoundCase{1023, "0.001023", "0.000511"}}) {
+        HistogramSnapshot histogram{};
+        histogram.buckets[HistogramSnapshot::bucket_of(bound.value_us)]++;
+
+        PrometheusText page{};
+        page.histogram("bounds", "Values on a bound", histogram, -1);
+
+        auto count_at = [&page](const char *le, const char *count) {
+            return page.str().find(std::string("bounds_bucket{le=\"") + le + "\"} " + count + "\n")
+                   != std::string::npos;
+        };
+
+        verify(count_at(bound.le, "1"), "a histogram value on a bound is counted in its own le bucket");
+        verify(!bound.previous_le || count_at(bound.previous_le, "0"),
+               "a histogram value is left out of the bound before it");
+    }
+}
+
+int main(int argc, char **argv) {
+    auto options = parse_options(argc, argv);
+    JsonResults results{};
+
+    check_histogram_bounds();
+    bench_queue_push_pop(results, options);
+    bench_queue_push_pop(results, options);
+
+    for (uint32_t workers = 1; workers <= options.max_workers; workers *= 2) {
+        bench_empty_task_throughput<ThreadPool>(results, options, "IndexedPriorityQueue", workers,
+                                                YoungQueueMode::shared_queue, false);
+        bench_empty_task_throughput<ThreadPool>(results, options, "IndexedPriorityQueue", workers,
+                                                YoungQueueMode::work_stealing, false);
+        bench_empty_task_throughput<ThreadPool>(results, options, "IndexedPriorityQueue", workers,
+                                                YoungQueueMode::work_stealing, true);
+        bench_empty_task_throughput<FifoThreadPool>(results, options, "MpmcRing", workers,
+                                                    YoungQueueMode::shared_queue, false);
+        bench_empty_task_throughput<FifoThreadPool>(results, options, "MpmcRing", workers,
+                                                    YoungQueueMode::work_stealing, false);
+
+        // full trace rings drop events, the cost of recording them stays
+        Tracer::enable(true);
+        bench_empty_task_throughput<ThreadPool>(results, options, "IndexedPriorityQueue", workers,
+                                                YoungQueueMode::work_stealing, false);
+        Tracer::enable(false);
+        bench_submit_to_start_latency(results, options, workers);
+        bench_parallel_algorithms(results, options, workers);
+#ifdef LAB2_COROUTINES
+        bench_coroutines(results, options, workers);
+#endif
+    }
+
+    Logger::instance().flush();
+
+    if (options.output_path.empty()) {
+        std::cout << results.str();
+    } else {
+        std::ofstream(options.output_path) << results.str();
+    }
+
+    return 0;
+}
@@ -1,38 +1,79 @@
 #include "task_manager.h"
+#include "metrics_exporter.h"
+#include <cinttypes>
+#include <fstream>
 #include <iomanip>
+#include <limits>
+#include <stdexcept>
 
 #ifdef LAB2_TASK_MANAGER_H
 
-void print_telemetry(const Telemetry &tel) {
-    printf("Total time asleep: %ld ms\n", tel.get_total_sleep_time());
+// the caller holds stdout_lock
+void print_histogram(const char *name, const HistogramSnapshot &histogram) {
+    printf("%s p50/p99/p999: %.3f / %.3f / %.3f ms\n", name,
+           histogram.percentile(0.5) / 1000, histogram.percentile(0.99) / 1000, histogram.percentile(0.999) / 1000);
+}
+
+void print_telemetry(const TelemetrySnapshot &tel) {
+    Logger::instance().flush();
+    write_lock _(stdout_lock);
+
+    printf("Total time asleep: %" PRIu64 " ms\n", tel.get_total_sleep_time());
     printf("Average main queue size: %.2f\n", tel.get_avg_main_queue_size());
     printf("Average secondary queue size: %.2f\n", tel.get_avg_secondary_queue_size());
-    printf("Tasks scheduled: %d\n", tel.get_scheduled_tasks());
-    printf("Tasks completed: %d\n", tel.get_completed_tasks());
+    printf("Tasks scheduled: %" PRIu64 "\n", tel.get_scheduled_tasks());
+    printf("Tasks completed: %" PRIu64 "\n", tel.get_completed_tasks());
+    printf("Tasks expired: %" PRIu64 ", cancelled: %" PRIu64 "\n",
+           tel.get_expired_tasks(), tel.get_cancelled_tasks());
+    printf("Tasks rejected: %" PRIu64 ", evicted: %" PRIu64 ", run by caller: %" PRIu64 "\n",
+           tel.get_rejected_tasks(), tel.get_evicted_tasks(), tel.get_tasks_run_by_caller());
     printf("Average task execution time: %.2f ms\n", tel.get_avg_task_execution_time());
+    printf("Tasks stolen: %" PRIu64 " of %" PRIu64 " steal attempts\n",
+           tel.get_stolen_tasks(), tel.get_steal_attempts());
+    printf("Average dequeue time: %.2f us\n", tel.get_avg_dequeue_time_us());
+    printf("Task allocator hit rate: %.2f%%\n", tel.get_allocator_hit_rate() * 100);
+    print_histogram("Queue wait", tel.queue_wait);
+    print_histogram("Task execution", tel.execution_time);
+    print_histogram("Time asleep", tel.sleep_time);
 }
 
-void application_automated(bool finish_gracefully = true) {
-    Telemetry telemetry{};
+void application_automated(const LoadProfile &profile, const MetricsOptions &metrics,
+                           bool finish_gracefully = true,
+                           YoungQueueMode queue_mode = YoungQueueMode::work_stealing) {
+    TelemetrySnapshot telemetry{};
+    HistogramSnapshot response_time{}, uncorrected_response_time{};
 
     std::thread t([&]() {
-        ThreadPool pool(3, true);
-        TaskManager taskManager(&pool, true);
+        ThreadPool pool(3, true, queue_mode);
+        MetricsExporter exporter(metrics, [&pool]() { return render_pool_metrics(pool); });
+        TaskManager taskManager(&pool, true, profile);
 
-        std::this_thread::sleep_for(std::chrono::seconds(60));
+        Clock::sleep_for(std::chrono::seconds(60));
 
         taskManager.terminate(finish_gracefully);
 
-        telemetry = taskManager.get_telemetry();
+        telemetry = taskManager.get_telemetry().snapshot();
+        response_time = taskManager.get_response_time();
+        uncorrected_response_time = taskManager.get_response_time(false);
     });
 
     t.join();
 
-    std::cout << std::endl;
+    Logger::instance().flush();
+    {
+        write_lock _(stdout_lock);
+        std::cout << std::endl;
+    }
+
     print_telemetry(telemetry);
+
+    write_lock _(stdout_lock);
+    print_histogram("Response time", response_time);
+    print_histogram("Response time from add_task", uncorrected_response_time);
 }
 
 void print_menu() {
+    write_lock _(stdout_lock);
 
     std::cout << "1. Start task manager\n"
               << "2. Stop task manager\n"
@@ -94,12 +135,13 @@ void process_menu_option(int32_t option, TaskManager *manager) {
         case menu.scheduled_tasks: {
             auto amount = manager->get_scheduled_tasks_amount();
 
+            Logger::instance().flush();
             write_lock _(stdout_lock);
             std::cout << terminal.cyan << "Total scheduled tasks amount: " << amount << terminal.reset << std::endl;
             return;
         }
         case menu.print_telemetry: {
-            auto telemetry = manager->get_telemetry();
+            auto telemetry = manager->get_telemetry().snapshot();
 
             print_telemetry(telemetry);
             return;
@@ -112,13 +154,14 @@ void process_menu_option(int32_t option, TaskManager *manager) {
     }
 }
 
-void application_with_menu() {
+void application_with_menu(const MetricsOptions &metrics) {
     char user_input[100]{};
     int32_t user_option;
 
     print_menu();
 
     ThreadPool pool{3};
+    MetricsExporter exporter(metrics, [&pool]() { return render_pool_metrics(pool); });
     TaskManager task_manager{&pool};
 
     do {
@@ -139,13 +182,102 @@ void application_with_menu() {
 
 #define START_AUTOMATED
 
-int main() {
+// usage: app [--time-scale N] [--producers N] [--rate R] [--arrivals constant|poisson|on_off] [--cpu-share F]
+//            [--trace trace.json] [--metrics-port N] [--metrics-file metrics.prom]
+// a time scale above 1 replays the workload in simulated time, rate is in tasks per second of every producer,
+// cpu-share is the share of tasks that keep a core busy for 50-200 ms instead of sleeping for 5-10 s,
+// trace writes the task lifecycle in Chrome trace-event format,
+// the metrics are served in Prometheus text format on 127.0.0.1 and rewritten into the file every second
+int main(int argc, char **argv) {
+    LoadProfile profile{};
+    MetricsOptions metrics{};
+    std::string trace_path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+
+        // every option takes a value
+        if (i + 1 == argc) {
+            std::cerr << "Missing value for " << option << std::endl;
+            return 1;
+        }
+
+        std::string value = argv[++i];
+
+        // the whole value has to be a number in range, "8x" or a port of 70000 is an error rather than 8 or 4464
+        auto number = [&value](double min, double max) {
+            size_t parsed = 0;
+            double result = std::stod(value, &parsed);
+
+            if (parsed != value.size() || !(result >= min && result <= max))
+                throw std::out_of_range(value);
+
+            return result;
+        };
+
+        auto integer = [&value](uint64_t min, uint64_t max) {
+            size_t parsed = 0;
+            uint64_t result = value.empty() || value[0] == '-' ? 0 : std::stoull(value, &parsed);
+
+            if (parsed == 0 || parsed != value.size() || result < min || result > max)
+                throw std::out_of_range(value);
+
+            return result;
+        };
+
+        try {
+            if (option == "--time-scale") {
+                Clock::set_time_scale(std::max(1.0, number(0, std::numeric_limits<double>::max())));
+            } else if (option == "--producers") {
+                profile.producers = (uint32_t) integer(1, std::numeric_limits<uint32_t>::max());
+            } else if (option == "--rate") {
+                profile.rate = number(std::numeric_limits<double>::min(), std::numeric_limits<double>::max());
+            } else if (option == "--arrivals") {
+                if (value == "constant") {
+                    profile.arrivals = ArrivalProcess::constant;
+                } else if (value == "poisson") {
+                    profile.arrivals = ArrivalProcess::poisson;
+                } else if (value == "on_off") {
+                    profile.arrivals = ArrivalProcess::on_off;
+                } else {
+                    throw std::invalid_argument(value);
+                }
+            } else if (option == "--metrics-port") {
+                metrics.port = (uint16_t) integer(0, std::numeric_limits<uint16_t>::max());
+            } else if (option == "--metrics-file") {
+                metrics.file_path = value;
+            } else if (option == "--trace") {
+                trace_path = value;
+                Tracer::enable(true);
+            } else if (option == "--cpu-share") {
+                auto cpu_share = number(0, 1);
+
+                profile.costs = {
+                        TaskCost{TaskCostKind::sleep, std::chrono::milliseconds(5000),
+                                 std::chrono::milliseconds(10000), 1 - cpu_share},
+                        TaskCost{TaskCostKind::cpu, std::chrono::milliseconds(50), std::chrono::milliseconds(200),
+                                 cpu_share},
+                };
+            } else {
+                std::cerr << "Unknown option " << option << std::endl;
+                return 1;
+            }
+        } catch (const std::exception &) {
+            std::cerr << "Invalid value " << value << " for " << option << std::endl;
+            return 1;
+        }
+    }
 
 #ifdef START_AUTOMATED
-    application_automated();
+    application_automated(profile, metrics);
 #else
-    application_with_menu();
+    application_with_menu(metrics);
 #endif
 
+    if (!trace_path.empty()) {
+        std::ofstream trace(trace_path);
+        Tracer::instance().write_chrome_trace(trace);
+    }
+
     return 0;
 }
@@ -0,0 +1,212 @@
+#include "metrics_exporter.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // one bound per power of two up to about 4.8 hours
+    constexpr uint32_t histogram_bounds_num = 35;
+
+    std::string format_value(double value) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.12g", value);
+        return buffer;
+    }
+
+    void send_all(int socket, const std::string &data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            auto written = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0)
+                return;
+
+            sent += written;
+        }
+    }
+}
+
+void PrometheusText::family(const char *name, const char *type, const char *help) {
+    this->text += "# HELP ";
+    this->text += name;
+    this->text += ' ';
+    this->text += help;
+    this->text += "\n# TYPE ";
+    this->text += name;
+    this->text += ' ';
+    this->text += type;
+    this->text += '\n';
+}
+
+void PrometheusText::sample(const char *name, double value, const std::string &labels) {
+    this->text += name;
+
+    if (!labels.empty()) {
+        this->text += '{';
+        this->text += labels;
+        this->text += '}';
+    }
+
+    this->text += ' ';
+    this->text += format_value(value);
+    this->text += '\n';
+}
+
+void PrometheusText::histogram(const char *name, const char *help, const HistogramSnapshot &histogram,
+                               double sum_us) {
+    this->family(name, "histogram", help);
+
+    std::string bucket = std::string(name) + "_bucket";
+    uint64_t cumulative = 0;
+    double estimated_sum_us = 0;
+    uint32_t bucket_index = 0;
+
+    for (uint32_t bound = 0; bound < histogram_bounds_num; bound++) {
+        uint64_t bound_us = 1ull << bound;
+        uint64_t covered_us = 0;
+
+        // le is inclusive. Past 4 us the bucket starting at a power of two also holds the values after it,
+        // so the bound ends with the bucket before it and is labelled with what it really covers, 2^k - 1
+        for (; bucket_index < HistogramSnapshot::buckets_num
+               && HistogramSnapshot::bucket_upper_bound(bucket_index) <= bound_us; bucket_index++) {
+            auto count = histogram.buckets[bucket_index];
+
+            cumulative += count;
+            covered_us = HistogramSnapshot::bucket_upper_bound(bucket_index);
+            estimated_sum_us += (double) count * (double) (HistogramSnapshot::bucket_lower_bound(bucket_index)
+                                                           + HistogramSnapshot::bucket_upper_bound(bucket_index)) / 2;
+        }
+
+        this->sample(bucket.c_str(), (double) cumulative, "le=\"" + format_value((double) covered_us / 1e6) + "\"");
+    }
+
+    for (; bucket_index < HistogramSnapshot::buckets_num; bucket_index++) {
+        auto count = histogram.buckets[bucket_index];
+
+        cumulative += count;
+        estimated_sum_us += (double) count * (double) (HistogramSnapshot::bucket_lower_bound(bucket_index)
+                                                       + HistogramSnapshot::bucket_upper_bound(bucket_index)) / 2;
+    }
+
+    this->sample(bucket.c_str(), (double) cumulative, "le=\"+Inf\"");
+    this->sample((std::string(name) + "_sum").c_str(), (sum_us < 0 ? estimated_sum_us : sum_us) / 1e6);
+    this->sample((std::string(name) + "_count").c_str(), (double) cumulative);
+}
+
+MetricsExporter::MetricsExporter(const MetricsOptions &options, std::function<std::string()> render) {
+    this->options = options;
+    this->render = std::move(render);
+
+    if (options.port != 0) {
+        this->listener = socket(AF_INET, SOCK_STREAM, 0);
+
+        int reuse = 1;
+        setsockopt(this->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(options.port);
+
+        if (this->listener < 0 || bind(this->listener, (sockaddr *) &address, sizeof(address)) != 0
+            || listen(this->listener, 16) != 0) {
+            LOG_ERROR(terminal.red, "Metrics listener could not bind port {%llu}\n", options.port);
+
+            if (this->listener >= 0)
+                close(this->listener);
+            this->listener = -1;
+        } else {
+            this->port = options.port;
+            this->server = std::thread(&MetricsExporter::serve_routine, this);
+
+            LOG_INFO(terminal.cyan, "Metrics served on 127.0.0.1:%llu\n", this->port);
+        }
+    }
+
+    if (!options.file_path.empty())
+        this->file_writer = std::thread(&MetricsExporter::file_routine, this);
+}
+
+MetricsExporter::~MetricsExporter() {
+    {
+        std::lock_guard _(this->running_lock);
+        this->running = false;
+        this->running_waiter.notify_all();
+    }
+
+    if (this->server.joinable())
+        this->server.join();
+
+    if (this->file_writer.joinable())
+        this->file_writer.join();
+
+    if (this->listener >= 0)
+        close(this->listener);
+}
+
+void MetricsExporter::serve_routine() {
+    while (true) {
+        {
+            std::lock_guard _(this->running_lock);
+            if (!this->running)
+                return;
+        }
+
+        // woken now and then to see whether the exporter is being destroyed
+        pollfd listening{this->listener, POLLIN, 0};
+        if (poll(&listening, 1, 200) <= 0)
+            continue;
+
+        int client = accept(this->listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // whatever was asked for, the answer is the metrics page
+        char request[2048];
+        recv(client, request, sizeof(request), 0);
+
+        auto body = this->render();
+        send_all(client, "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n\r\n" + body);
+
+        close(client);
+    }
+}
+
+void MetricsExporter::file_routine() {
+    std::unique_lock _(this->running_lock);
+
+    while (this->running) {
+        _.unlock();
+        this->write_file();
+        _.lock();
+
+        // wall time even in a simulation, it is read by tools outside of it
+        this->running_waiter.wait_for(_, this->options.file_interval, [this]() { return !this->running; });
+    }
+}
+
+void MetricsExporter::write_file() {
+    // a scraper reading the file never sees it half written
+    auto temporary_path = this->options.file_path + ".tmp";
+
+    {
+        std::ofstream file(temporary_path, std::ios::trunc);
+        file << this->render();
+
+        if (!file)
+            return;
+    }
+
+    std::rename(temporary_path.c_str(), this->options.file_path.c_str());
+}
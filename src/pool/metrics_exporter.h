@@ -0,0 +1,125 @@
+#ifndef LAB2_METRICS_EXPORTER_H
+#define LAB2_METRICS_EXPORTER_H
+
+#include "thread_pool.h"
+
+#include <functional>
+#include <string>
+
+// Builds a page in the Prometheus text exposition format, one family at a time
+class PrometheusText {
+public:
+    // TYPE is counter, gauge or histogram
+    void family(const char *name, const char *type, const char *help);
+
+    void sample(const char *name, double value, const std::string &labels = "");
+
+    // bounds are the last bucket edge at or below every power of two microseconds, values are exposed in seconds.
+    // A negative sum_us is estimated from the bucket midpoints.
+    void histogram(const char *name, const char *help, const HistogramSnapshot &histogram, double sum_us);
+
+    [[nodiscard]] const std::string &str() const {
+        return this->text;
+    }
+
+private:
+    std::string text;
+};
+
+struct MetricsOptions {
+    // 0 leaves the HTTP listener off, it only listens on 127.0.0.1
+    uint16_t port = 0;
+    // empty leaves the file off, it is replaced whole every interval of wall time
+    std::string file_path{};
+    std::chrono::milliseconds file_interval{1000};
+};
+
+// Serves whatever render returns to every GET on the port and rewrites the file with it.
+// render runs on the exporter's threads and has to be safe to call while the pool works.
+class MetricsExporter {
+public:
+    MetricsExporter(const MetricsOptions &options, std::function<std::string()> render);
+
+    ~MetricsExporter();
+
+    // the port the listener is bound to, 0 when it is off or could not bind
+    [[nodiscard]] uint16_t get_port() const {
+        return this->port;
+    }
+
+public:
+    MetricsExporter(MetricsExporter const &other) = delete;
+
+    MetricsExporter &operator=(MetricsExporter const &rhs) = delete;
+
+private:
+    void serve_routine();
+
+    void file_routine();
+
+    void write_file();
+
+private:
+    MetricsOptions options;
+    std::function<std::string()> render;
+
+    int listener = -1;
+    uint16_t port = 0;
+
+    bool running = true;
+    std::mutex running_lock;
+    std::condition_variable running_waiter;
+
+    std::thread server;
+    std::thread file_writer;
+};
+
+// Telemetry of the pool plus the depth of every level. Telemetry is read from its shards
+// without a lock, a queue depth costs a read lock on the heap at most.
+template <typename Policy>
+std::string render_pool_metrics(BasicThreadPool<Policy> &pool) {
+    auto telemetry = pool.get_telemetry().snapshot();
+    PrometheusText page{};
+
+    auto counter = [&page](const char *name, const char *help, uint64_t value) {
+        page.family(name, "counter", help);
+        page.sample(name, (double) value);
+    };
+
+    counter("lab2_tasks_scheduled_total", "Tasks queued into the pool", telemetry.tasks_scheduled);
+    counter("lab2_tasks_completed_total", "Tasks run to completion by workers", telemetry.tasks_completed);
+    counter("lab2_tasks_expired_total", "Tasks skipped as their deadline had passed", telemetry.tasks_expired);
+    counter("lab2_tasks_cancelled_total", "Tasks cancelled while queued", telemetry.tasks_cancelled);
+    counter("lab2_tasks_rejected_total", "Tasks refused by add_task", telemetry.tasks_rejected);
+    counter("lab2_tasks_evicted_total", "Queued tasks dropped for tasks that run first", telemetry.tasks_evicted);
+    counter("lab2_tasks_run_by_caller_total", "Tasks run on the producer's thread", telemetry.tasks_run_by_caller);
+    counter("lab2_tasks_stolen_total", "Tasks taken from another worker's heap", telemetry.tasks_stolen);
+    counter("lab2_steal_attempts_total", "Looks into another worker's heap", telemetry.steal_attempts);
+    counter("lab2_task_allocations_total", "Task nodes handed out", telemetry.task_allocations);
+    counter("lab2_task_allocations_reused_total", "Task nodes served by a recycled node",
+            telemetry.task_allocations_reused);
+
+    page.family("lab2_queue_depth", "gauge", "Tasks queued per level, level 0 is the young generation");
+    page.sample("lab2_queue_depth", pool.currently_scheduled_tasks(), "level=\"0\"");
+    for (uint32_t level = 1; level < pool.get_levels_num(); level++)
+        page.sample("lab2_queue_depth", pool.currently_aged_tasks(level), "level=\"" + std::to_string(level) + "\"");
+
+    page.family("lab2_admitted_tasks", "gauge", "Admitted tasks no worker has taken yet");
+    page.sample("lab2_admitted_tasks", pool.currently_admitted_tasks());
+
+    page.family("lab2_outstanding_tasks", "gauge", "Queued and running tasks");
+    page.sample("lab2_outstanding_tasks", pool.currently_outstanding_tasks());
+
+    page.family("lab2_young_workers", "gauge", "Active young workers");
+    page.sample("lab2_young_workers", pool.get_young_workers());
+
+    page.histogram("lab2_queue_wait_seconds", "Time from task creation to its start", telemetry.queue_wait, -1);
+    page.histogram("lab2_task_execution_seconds", "Time tasks ran", telemetry.execution_time,
+                   (double) telemetry.total_execution_time_us);
+    page.histogram("lab2_worker_sleep_seconds", "Time workers slept waiting for a task", telemetry.sleep_time,
+                   (double) telemetry.total_sleep_time_us);
+
+    return page.str();
+}
+
+#endif //LAB2_METRICS_EXPORTER_H
@@ -0,0 +1,71 @@
+#include "parallel_algorithms.h"
+
+ParallelJob::ParallelJob(size_t size, size_t grain, uint32_t participants, chunk_routine routine, void *context) {
+    this->size = size;
+    this->grain = grain;
+    this->participants = participants;
+    this->routine = routine;
+    this->context = context;
+}
+
+void ParallelJob::participate() {
+    size_t begin, end;
+
+    while (this->claim(begin, end)) {
+        try {
+            this->routine(this->context, begin, end);
+        } catch (...) {
+            this->fail(std::current_exception());
+        }
+
+        this->complete(end - begin);
+    }
+}
+
+void ParallelJob::wait() {
+    write_lock _(this->completion_lock);
+    this->completion_waiter.wait(_, [this]() { return this->done.load(std::memory_order_acquire) == this->size; });
+
+    if (this->error)
+        std::rethrow_exception(this->error);
+}
+
+bool ParallelJob::claim(size_t &begin, size_t &end) {
+    // after a failure the rest of the range is skipped, it still counts as done so that wait returns
+    if (this->failed.load(std::memory_order_acquire)) {
+        auto skipped = this->next.exchange(this->size, std::memory_order_relaxed);
+        if (skipped < this->size)
+            this->complete(this->size - skipped);
+
+        return false;
+    }
+
+    begin = this->next.load(std::memory_order_relaxed);
+
+    do {
+        if (begin >= this->size)
+            return false;
+
+        auto remaining = this->size - begin;
+        end = begin + std::min(remaining, std::max(this->grain, remaining / (2 * this->participants)));
+    } while (!this->next.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+
+    return true;
+}
+
+void ParallelJob::complete(size_t count) {
+    // the chunk's writes are published to the caller through done
+    if (this->done.fetch_add(count, std::memory_order_acq_rel) + count != this->size)
+        return;
+
+    write_lock _(this->completion_lock);
+    this->completion_waiter.notify_all();
+}
+
+void ParallelJob::fail(std::exception_ptr chunk_error) {
+    if (this->failed.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    write_lock _(this->completion_lock);
+    this->error = std::move(chunk_error);
+}
@@ -0,0 +1,173 @@
+#ifndef LAB2_PARALLEL_ALGORITHMS_H
+#define LAB2_PARALLEL_ALGORITHMS_H
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+
+// Shared state of one parallel call. Participants claim chunks of [0, size) until none is left;
+// a chunk is a share of what remains and shrinks down to the grain towards the end (guided
+// self-scheduling), so a worker that joins late or a slow chunk does not hold the others up.
+// The chunk routine is a plain function pointer over the caller's stack, nothing is allocated per chunk.
+class ParallelJob {
+public:
+    typedef void (*chunk_routine)(void *context, size_t begin, size_t end);
+
+    ParallelJob(size_t size, size_t grain, uint32_t participants, chunk_routine routine, void *context);
+
+    // runs chunks on the calling thread until there is none left to claim
+    void participate();
+
+    // waits for the chunks other participants are still running, rethrows the first exception of a chunk
+    void wait();
+
+public:
+    ParallelJob(ParallelJob const &other) = delete;
+
+    ParallelJob &operator=(ParallelJob const &rhs) = delete;
+
+private:
+    size_t size;
+    size_t grain;
+    uint32_t participants;
+
+    // only called for a claimed chunk, so a helper that runs after the call returned never touches it
+    chunk_routine routine;
+    void *context;
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr error{};
+
+    rw_lock completion_lock;
+    std::condition_variable_any completion_waiter{};
+
+private:
+    bool claim(size_t &begin, size_t &end);
+
+    void complete(size_t count);
+
+    void fail(std::exception_ptr chunk_error);
+};
+
+// Splits [0, size) between the caller and up to one helper task per young worker. The caller
+// always takes part, so a call made from a worker, on a paused pool or one that refuses the
+// helpers still finishes, on the caller's thread alone if need be.
+template <typename Pool, typename Chunk>
+void run_parallel(Pool &pool, size_t size, size_t grain, Chunk &chunk) {
+    if (size == 0)
+        return;
+
+    uint32_t workers = pool.alive() ? pool.get_young_workers() : 0;
+
+    // small enough that the tail is spread evenly, large enough that claiming stays cheap
+    if (grain == 0)
+        grain = std::max<size_t>(1, size / ((workers + 1) * 64));
+
+    auto helpers = (uint32_t) std::min<size_t>(workers, (size - 1) / grain);
+    if (helpers == 0) {
+        chunk(size_t(0), size);
+        return;
+    }
+
+    auto job = std::make_shared<ParallelJob>(size, grain, helpers + 1, [](void *context, size_t begin, size_t end) {
+        (*static_cast<Chunk *>(context))(begin, end);
+    }, &chunk);
+
+    std::vector<ThreadTask> tasks;
+    tasks.reserve(helpers);
+    for (uint32_t i = 0; i < helpers; i++)
+        tasks.push_back(ThreadTask{[job]() { job->participate(); }, pool.reserve_task_id(), Clock::now(),
+                                   std::chrono::milliseconds(0)});
+
+    // helpers the pool refuses are not needed, the participants that are there take their chunks
+    pool.add_tasks(std::move(tasks));
+
+    job->participate();
+    job->wait();
+}
+
+// body(i) for every i in [first, last), 0 for grain picks it from the range and the pool size
+template <typename Pool, typename Index, typename Body>
+void parallel_for(Pool &pool, Index first, Index last, Body &&body, size_t grain = 0) {
+    static_assert(std::is_integral_v<Index>, "parallel_for runs over a range of integers");
+
+    if (last <= first)
+        return;
+
+    auto chunk = [&](size_t begin, size_t end) {
+        for (auto i = first + (Index) begin; i < first + (Index) end; i++)
+            body(i);
+    };
+
+    run_parallel(pool, (size_t) (last - first), grain, chunk);
+}
+
+// reduce(identity, map(i)) over [first, last). Partial results are combined in the order their
+// chunks finish, so reduce has to be associative and commutative, as for std::reduce
+template <typename Pool, typename Index, typename T, typename Map, typename Reduce>
+T parallel_reduce(Pool &pool, Index first, Index last, T identity, Map &&map, Reduce &&reduce, size_t grain = 0) {
+    static_assert(std::is_integral_v<Index>, "parallel_reduce runs over a range of integers");
+
+    T result = identity;
+    if (last <= first)
+        return result;
+
+    rw_lock result_lock;
+
+    auto chunk = [&](size_t begin, size_t end) {
+        T partial = identity;
+        for (auto i = first + (Index) begin; i < first + (Index) end; i++)
+            partial = reduce(std::move(partial), map(i));
+
+        write_lock _(result_lock);
+        result = reduce(std::move(result), std::move(partial));
+    };
+
+    run_parallel(pool, (size_t) (last - first), grain, chunk);
+
+    return result;
+}
+
+// Sorts one block per participant, then merges neighbouring blocks pairwise, half as many merges
+// each round. The last merge runs on one thread, which bounds the speedup by log2 of the blocks.
+template <typename Pool, typename RandomIt, typename Compare = std::less<>>
+void parallel_sort(Pool &pool, RandomIt first, RandomIt last, Compare comparator = Compare{}) {
+    // below it a block is sorted faster than a task is handed over
+    constexpr size_t min_block_size = 1 << 13;
+
+    auto size = (size_t) std::distance(first, last);
+    auto blocks = std::min<size_t>(pool.get_young_workers() + 1, size / min_block_size);
+
+    if (blocks < 2) {
+        std::sort(first, last, comparator);
+        return;
+    }
+
+    auto bound = [&](size_t block) {
+        return first + (typename std::iterator_traits<RandomIt>::difference_type) (size * block / blocks);
+    };
+
+    parallel_for(pool, size_t(0), blocks, [&](size_t block) {
+        std::sort(bound(block), bound(block + 1), comparator);
+    }, 1);
+
+    for (size_t width = 1; width < blocks; width *= 2) {
+        parallel_for(pool, size_t(0), (blocks + 2 * width - 1) / (2 * width), [&](size_t pair) {
+            auto left = pair * 2 * width;
+            auto middle = std::min(left + width, blocks);
+            auto right = std::min(left + 2 * width, blocks);
+
+            if (middle < right)
+                std::inplace_merge(bound(left), bound(middle), bound(right), comparator);
+        }, 1);
+    }
+}
+
+#endif //LAB2_PARALLEL_ALGORITHMS_H
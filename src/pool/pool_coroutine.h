@@ -0,0 +1,269 @@
+#ifndef LAB2_POOL_COROUTINE_H
+#define LAB2_POOL_COROUTINE_H
+
+#ifndef __cpp_impl_coroutine
+#error "LAB2_COROUTINES needs a C++20 compiler with coroutine support"
+#endif
+
+#include "thread_pool.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// co_await pool.schedule() suspends the coroutine and resumes it on a pool worker.
+// A pool that refuses or drops the task resumes it where it is and co_await throws.
+template <typename Pool>
+class ScheduleAwaitable {
+public:
+    ScheduleAwaitable(Pool *pool, std::chrono::milliseconds wait_time) {
+        this->pool = pool;
+        this->wait_time = wait_time;
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> coroutine) {
+        ThreadTask task{CoroutineResumer(this, coroutine), this->pool->reserve_task_id(), Clock::now(),
+                        this->wait_time};
+
+        // once taken, the coroutine may already run on a worker and this awaitable be gone
+        if (this->pool->add_task(std::move(task)))
+            return true;
+
+        // run by caller_runs, the coroutine has been resumed already
+        if (!task.executable)
+            return true;
+
+        // a refused task is not moved from, its resumer must not fire when it goes out of scope
+        this->armed = false;
+        this->refused = true;
+        return false;
+    }
+
+    void await_resume() const {
+        if (this->refused)
+            throw std::runtime_error("Task was dropped before it ran");
+    }
+
+private:
+    class CoroutineResumer {
+    public:
+        CoroutineResumer(ScheduleAwaitable *awaitable, std::coroutine_handle<> coroutine)
+                : awaitable(awaitable), coroutine(coroutine) {}
+
+        CoroutineResumer(CoroutineResumer &&other) noexcept
+                : awaitable(other.awaitable), coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+        inline ~CoroutineResumer() {
+            if (this->coroutine && this->awaitable->armed) {
+                this->awaitable->refused = true;
+                std::exchange(this->coroutine, nullptr).resume();
+            }
+        }
+
+        void operator()() {
+            std::exchange(this->coroutine, nullptr).resume();
+        }
+
+    public:
+        CoroutineResumer(CoroutineResumer const &other) = delete;
+
+        CoroutineResumer &operator=(CoroutineResumer const &rhs) = delete;
+
+    private:
+        ScheduleAwaitable *awaitable;
+        std::coroutine_handle<> coroutine;
+    };
+
+    Pool *pool;
+    std::chrono::milliseconds wait_time;
+
+    bool armed = true;
+    bool refused = false;
+};
+
+template <typename Policy>
+ScheduleAwaitable<BasicThreadPool<Policy>> BasicThreadPool<Policy>::schedule(std::chrono::milliseconds wait_time) {
+    return ScheduleAwaitable<BasicThreadPool>{this, wait_time};
+}
+
+template <typename R>
+class PoolTaskPromiseBase {
+public:
+    void return_value(R value) {
+        this->value.emplace(std::move(value));
+    }
+
+    R result() {
+        if (this->error)
+            std::rethrow_exception(this->error);
+
+        return std::move(*this->value);
+    }
+
+protected:
+    std::optional<R> value{};
+    std::exception_ptr error{};
+};
+
+template <>
+class PoolTaskPromiseBase<void> {
+public:
+    void return_void() {}
+
+    void result() {
+        if (this->error)
+            std::rethrow_exception(this->error);
+    }
+
+protected:
+    std::exception_ptr error{};
+};
+
+// Lazy coroutine: starts when it is awaited and resumes the awaiting coroutine when it finishes,
+// on whatever thread it finished on. BasicThreadPool::spawn runs one from plain code.
+template <typename R = void>
+class PoolTask {
+public:
+    class promise_type : public PoolTaskPromiseBase<R> {
+    public:
+        PoolTask get_return_object() {
+            return PoolTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept {
+            struct FinalAwaitable {
+                bool await_ready() const noexcept { return false; }
+
+                // symmetric transfer, so long chains of awaits do not grow the stack
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> coroutine) noexcept {
+                    auto continuation = coroutine.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            return FinalAwaitable{};
+        }
+
+        void unhandled_exception() {
+            this->error = std::current_exception();
+        }
+
+    private:
+        friend class PoolTask;
+
+        std::coroutine_handle<> continuation{};
+    };
+
+    PoolTask(PoolTask &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+    PoolTask &operator=(PoolTask &&rhs) noexcept {
+        if (this != &rhs) {
+            if (this->coroutine)
+                this->coroutine.destroy();
+
+            this->coroutine = std::exchange(rhs.coroutine, nullptr);
+        }
+
+        return *this;
+    }
+
+    inline ~PoolTask() {
+        if (this->coroutine)
+            this->coroutine.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct TaskAwaitable {
+            std::coroutine_handle<promise_type> coroutine;
+
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                this->coroutine.promise().continuation = awaiting;
+                return this->coroutine;
+            }
+
+            R await_resume() {
+                return this->coroutine.promise().result();
+            }
+        };
+
+        return TaskAwaitable{this->coroutine};
+    }
+
+public:
+    PoolTask(PoolTask const &other) = delete;
+
+    PoolTask &operator=(PoolTask const &rhs) = delete;
+
+private:
+    explicit PoolTask(std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+    std::coroutine_handle<promise_type> coroutine;
+};
+
+// Fire and forget coroutine that frees its own frame, the glue between spawn and its future
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+template <typename Pool, typename R>
+DetachedCoroutine run_spawned(Pool *pool, PoolTask<R> task, TaskPromise<R> promise) {
+    using value_type = std::conditional_t<std::is_void_v<R>, bool, R>;
+
+    std::optional<value_type> value{};
+    std::exception_ptr error{};
+
+    try {
+        co_await pool->schedule();
+
+        if constexpr (std::is_void_v<R>) {
+            co_await std::move(task);
+            value.emplace(true);
+        } else {
+            value.emplace(co_await std::move(task));
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    auto complete = [&]() -> R {
+        if (error)
+            std::rethrow_exception(error);
+
+        if constexpr (!std::is_void_v<R>)
+            return std::move(*value);
+    };
+
+    promise.run(complete);
+}
+
+template <typename Policy>
+template <typename R>
+TaskFuture<R> BasicThreadPool<Policy>::spawn(PoolTask<R> &&task) {
+    auto state = std::make_shared<TaskState<R>>();
+    TaskFuture<R> future{state};
+
+    run_spawned(this, std::move(task), TaskPromise<R>(std::move(state)));
+
+    return future;
+}
+
+#endif //LAB2_POOL_COROUTINE_H
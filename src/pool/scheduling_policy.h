@@ -0,0 +1,122 @@
+#ifndef LAB2_SCHEDULING_POLICY_H
+#define LAB2_SCHEDULING_POLICY_H
+
+#include "helper.h"
+#include "concurrent_queue.h"
+#include "mpmc_ring.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+typedef IntrusivePtr<ThreadTask> TaskHandle;
+
+// A scheduling policy is the comparator of the pool's heaps, (a, b) is true when a runs after b.
+// It is a type, so the heap calls it inline. virtual_time says whether the pool has to stamp
+// tasks with a FairShareClock before they are queued.
+
+// Tasks run in the order they were added. There is nothing to compare, so the pool queues them
+// into an MpmcRing instead of a heap and gives up promotion and cancellation for it.
+struct FirstInFirstOut {
+    static constexpr bool virtual_time = false;
+};
+
+// wait_time stands in for the length of the job, the shortest goes first
+struct ShortestJobFirst {
+    static constexpr bool virtual_time = false;
+
+    static bool runs_after(const ThreadTask &a, const ThreadTask &b) {
+        return a.wait_time > b.wait_time;
+    }
+
+    bool operator()(const TaskHandle &a, const TaskHandle &b) const {
+        return runs_after(*a, *b);
+    }
+};
+
+// tasks without a deadline go after every task with one, and among themselves by wait_time
+struct EarliestDeadlineFirst {
+    static constexpr bool virtual_time = false;
+
+    static bool runs_after(const ThreadTask &a, const ThreadTask &b) {
+        if (a.deadline != b.deadline)
+            return a.deadline > b.deadline;
+
+        return a.wait_time > b.wait_time;
+    }
+
+    bool operator()(const TaskHandle &a, const TaskHandle &b) const {
+        return runs_after(*a, *b);
+    }
+};
+
+// Tenants share the pool in proportion to their weights, whatever they submit
+struct WeightedFairQueuing {
+    static constexpr bool virtual_time = true;
+
+    static bool runs_after(const ThreadTask &a, const ThreadTask &b) {
+        if (a.virtual_finish != b.virtual_finish)
+            return a.virtual_finish > b.virtual_finish;
+
+        return a.wait_time > b.wait_time;
+    }
+
+    bool operator()(const TaskHandle &a, const TaskHandle &b) const {
+        return runs_after(*a, *b);
+    }
+};
+
+template <typename Policy>
+struct PolicyQueue {
+    typedef IndexedPriorityQueue<ThreadTask, Policy> type;
+};
+
+template <>
+struct PolicyQueue<FirstInFirstOut> {
+    typedef MpmcRing<TaskHandle> type;
+};
+
+// Self-clocked virtual time of weighted fair queuing. Every task counts as one unit of work,
+// as the pool knows nothing about its cost, so a tenant of weight 2 gets twice the tasks run
+// of a tenant of weight 1 while both have tasks queued. Tenants default to weight 1.
+class FairShareClock {
+    static constexpr double unit = 1 << 20;
+    static constexpr double min_weight = 1.0 / 1024;
+
+    struct Tenant {
+        double weight = 1;
+        uint64_t last_finish = 0;
+    };
+
+public:
+    void set_weight(uint32_t tenant, double weight) {
+        write_lock _(this->lock);
+        this->tenants[tenant].weight = std::max(weight, min_weight);
+    }
+
+    // the virtual time the task finishes at, it starts once the tenant's previous task finished
+    // or at the current virtual time for a tenant that was idle
+    uint64_t stamp(uint32_t tenant) {
+        write_lock _(this->lock);
+        auto &state = this->tenants[tenant];
+
+        auto start = std::max(state.last_finish, this->virtual_time.load(std::memory_order_relaxed));
+        state.last_finish = start + (uint64_t) (unit / state.weight);
+
+        return state.last_finish;
+    }
+
+    // called as a task starts, the virtual time is the stamp of the task in service
+    void advance(uint64_t virtual_finish) {
+        auto current = this->virtual_time.load(std::memory_order_relaxed);
+        while (current < virtual_finish
+               && !this->virtual_time.compare_exchange_weak(current, virtual_finish, std::memory_order_relaxed));
+    }
+
+private:
+    std::atomic<uint64_t> virtual_time{0};
+
+    rw_lock lock;
+    std::unordered_map<uint32_t, Tenant> tenants;
+};
+
+#endif //LAB2_SCHEDULING_POLICY_H
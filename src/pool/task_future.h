@@ -0,0 +1,150 @@
+#ifndef LAB2_TASK_FUTURE_H
+#define LAB2_TASK_FUTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+template <typename R>
+class TaskState {
+    using value_type = std::conditional_t<std::is_void_v<R>, bool, R>;
+
+public:
+    template <typename FT>
+    void run(FT &func) {
+        try {
+            if constexpr (std::is_void_v<R>) {
+                func();
+                this->value.emplace(true);
+            } else {
+                this->value.emplace(func());
+            }
+        } catch (...) {
+            this->error = std::current_exception();
+        }
+
+        this->complete();
+    }
+
+    void fail(std::exception_ptr exception) {
+        this->error = std::move(exception);
+        this->complete();
+    }
+
+    [[nodiscard]] bool ready() const {
+        return this->is_ready.load(std::memory_order_acquire);
+    }
+
+    void wait() {
+        if (this->ready())
+            return;
+
+        this->has_waiters.store(true);
+
+        std::unique_lock _(this->lock);
+        this->waiter.wait(_, [this]() { return this->is_ready.load(); });
+    }
+
+    template <typename Rep, typename Period>
+    bool wait_for(std::chrono::duration<Rep, Period> timeout) {
+        if (this->ready())
+            return true;
+
+        this->has_waiters.store(true);
+
+        std::unique_lock _(this->lock);
+        return this->waiter.wait_for(_, timeout, [this]() { return this->is_ready.load(); });
+    }
+
+    R get() {
+        this->wait();
+
+        if (this->error)
+            std::rethrow_exception(this->error);
+
+        if constexpr (!std::is_void_v<R>)
+            return std::move(*this->value);
+    }
+
+private:
+    std::atomic<bool> is_ready{false};
+    std::atomic<bool> has_waiters{false};
+
+    std::optional<value_type> value{};
+    std::exception_ptr error{};
+
+    std::mutex lock;
+    std::condition_variable waiter;
+
+    // the mutex is only touched when somebody actually blocks on the result
+    void complete() {
+        this->is_ready.store(true);
+
+        if (this->has_waiters.load()) {
+            std::lock_guard _(this->lock);
+            this->waiter.notify_all();
+        }
+    }
+};
+
+// Completion handle returned by ThreadPool::submit
+template <typename R>
+class TaskFuture {
+public:
+    TaskFuture() = default;
+
+    explicit TaskFuture(std::shared_ptr<TaskState<R>> state) : state(std::move(state)) {}
+
+    [[nodiscard]] bool valid() const { return this->state != nullptr; }
+
+    [[nodiscard]] bool ready() const { return this->state->ready(); }
+
+    void wait() const { this->state->wait(); }
+
+    template <typename Rep, typename Period>
+    bool wait_for(std::chrono::duration<Rep, Period> timeout) const {
+        return this->state->wait_for(timeout);
+    }
+
+    R get() { return this->state->get(); }
+
+private:
+    std::shared_ptr<TaskState<R>> state;
+};
+
+// Producer side, fails the future when the task is dropped without running
+template <typename R>
+class TaskPromise {
+public:
+    explicit TaskPromise(std::shared_ptr<TaskState<R>> state) : state(std::move(state)) {}
+
+    TaskPromise(TaskPromise &&other) noexcept = default;
+
+    TaskPromise &operator=(TaskPromise &&rhs) noexcept = default;
+
+    inline ~TaskPromise() {
+        if (this->state)
+            this->state->fail(std::make_exception_ptr(std::runtime_error("Task was dropped before it ran")));
+    }
+
+    template <typename FT>
+    void run(FT &func) {
+        auto current_state = std::move(this->state);
+        current_state->run(func);
+    }
+
+public:
+    TaskPromise(TaskPromise const &other) = delete;
+
+    TaskPromise &operator=(TaskPromise const &rhs) = delete;
+
+private:
+    std::shared_ptr<TaskState<R>> state;
+};
+
+#endif //LAB2_TASK_FUTURE_H
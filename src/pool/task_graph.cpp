@@ -0,0 +1,155 @@
+#include "task_graph.h"
+
+TaskGraph::node_id TaskGraph::add_node(TaskFunction &&work, std::chrono::milliseconds wait_time) {
+    this->nodes.push_back(std::make_unique<GraphNode>());
+
+    auto &node = this->nodes.back();
+    node->id = this->nodes.size() - 1;
+    node->work = std::move(work);
+    node->wait_time = wait_time;
+
+    return node->id;
+}
+
+void TaskGraph::precede(node_id before, node_id after) {
+    this->nodes[before]->successors.push_back(this->nodes[after].get());
+    this->nodes[after]->predecessors++;
+}
+
+TaskFuture<void> TaskGraph::run() {
+    if (this->running.exchange(true, std::memory_order_acq_rel))
+        return TaskFuture<void>{};
+
+    auto completion = std::make_shared<TaskState<void>>();
+    this->completion = completion;
+
+    this->failed.store(false, std::memory_order_relaxed);
+    this->error = nullptr;
+
+    if (this->nodes.empty() || this->has_cycle()) {
+        this->running.store(false, std::memory_order_release);
+
+        if (this->nodes.empty()) {
+            auto nothing = []() {};
+            completion->run(nothing);
+        } else {
+            completion->fail(std::make_exception_ptr(std::logic_error("Task graph has a cycle")));
+        }
+
+        return TaskFuture<void>{completion};
+    }
+
+    std::vector<ThreadTask> roots;
+    for (auto &node: this->nodes) {
+        node->pending.store(node->predecessors, std::memory_order_relaxed);
+
+        if (node->predecessors == 0)
+            roots.push_back(this->make_task(node.get()));
+    }
+
+    this->remaining_nodes.store(this->nodes.size(), std::memory_order_release);
+
+    // roots the pool refuses are dropped and release the rest of the graph as failed
+    this->pool->add_tasks(roots.begin(), roots.end());
+
+    return TaskFuture<void>{completion};
+}
+
+bool TaskGraph::has_cycle() const {
+    std::vector<uint32_t> pending(this->nodes.size());
+    std::vector<const GraphNode *> ready;
+
+    for (size_t i = 0; i < this->nodes.size(); i++) {
+        pending[i] = this->nodes[i]->predecessors;
+
+        if (pending[i] == 0)
+            ready.push_back(this->nodes[i].get());
+    }
+
+    size_t visited = 0;
+    while (!ready.empty()) {
+        auto node = ready.back();
+        ready.pop_back();
+        visited++;
+
+        for (auto successor: node->successors)
+            if (--pending[successor->id] == 0)
+                ready.push_back(successor);
+    }
+
+    return visited != this->nodes.size();
+}
+
+ThreadTask TaskGraph::make_task(GraphNode *node) {
+    return ThreadTask{NodeLease(this, node), this->pool->reserve_task_id(), Clock::now(), node->wait_time};
+}
+
+void TaskGraph::execute(GraphNode *node) {
+    while (node) {
+        if (!this->failed.load(std::memory_order_acquire)) {
+            try {
+                node->work();
+            } catch (...) {
+                this->fail(std::current_exception());
+            }
+        }
+
+        node = this->release_successors(node);
+    }
+}
+
+void TaskGraph::drop(GraphNode *node) {
+    this->fail(std::make_exception_ptr(std::runtime_error("Task was dropped before it ran")));
+    this->execute(node);
+}
+
+void TaskGraph::fail(std::exception_ptr exception) {
+    bool expected = false;
+    if (this->failed.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+        this->error = std::move(exception);
+}
+
+TaskGraph::GraphNode *TaskGraph::release_successors(GraphNode *node) {
+    GraphNode *continuation = nullptr;
+    std::vector<ThreadTask> ready;
+
+    for (auto successor: node->successors) {
+        if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            continue;
+
+        if (!continuation) {
+            continuation = successor;
+        } else if (this->failed.load(std::memory_order_acquire)) {
+            // skipped nodes are not worth a round trip through the pool
+            this->execute(successor);
+        } else {
+            ready.push_back(this->make_task(successor));
+        }
+    }
+
+    if (!ready.empty())
+        this->pool->add_tasks(ready.begin(), ready.end());
+
+    // only after the successors are out, so the run cannot complete under them
+    this->node_finished();
+
+    return continuation;
+}
+
+void TaskGraph::node_finished() {
+    if (this->remaining_nodes.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // the graph may be run again or destroyed as soon as the run is over
+    auto completion = this->completion;
+    auto exception = this->error;
+
+    this->running.store(false, std::memory_order_release);
+
+    if (exception) {
+        completion->fail(exception);
+    } else {
+        auto nothing = []() {};
+        completion->run(nothing);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef LAB2_TASK_GRAPH_H
+#define LAB2_TASK_GRAPH_H
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Dependency graph of tasks run on a ThreadPool. A node is handed to the pool once its last
+// predecessor finishes; the finishing worker keeps one ready successor and runs it straight away,
+// so a chain of dependent nodes costs a single submit. Building the graph is not synchronized
+// and must not overlap with a run.
+class TaskGraph {
+public:
+    typedef uint32_t node_id;
+
+    explicit TaskGraph(ThreadPool *pool) {
+        this->pool = pool;
+    }
+
+    inline ~TaskGraph() { this->wait(); }
+
+public:
+    // wait_time is the node's priority in the pool, as for ThreadPool::submit
+    node_id add_node(TaskFunction &&work, std::chrono::milliseconds wait_time = std::chrono::milliseconds(0));
+
+    // after only becomes runnable once before has finished
+    void precede(node_id before, node_id after);
+
+    // the future fails with the first exception a node threw, the nodes after it are skipped;
+    // an invalid one is returned while the previous run is still going
+    TaskFuture<void> run();
+
+    void wait() {
+        if (this->completion)
+            this->completion->wait();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return this->nodes.size();
+    }
+
+public:
+    TaskGraph(TaskGraph const &other) = delete;
+
+    TaskGraph &operator=(TaskGraph const &rhs) = delete;
+
+private:
+    struct GraphNode {
+        node_id id;
+        TaskFunction work;
+        std::chrono::milliseconds wait_time;
+
+        std::vector<GraphNode *> successors{};
+        uint32_t predecessors = 0;
+
+        // predecessors not finished yet in the current run
+        std::atomic<uint32_t> pending{0};
+    };
+
+    // Owns the right to run a node, a task dropped by the pool without running releases it as failed
+    class NodeLease {
+    public:
+        NodeLease(TaskGraph *graph, GraphNode *node) : graph(graph), node(node) {}
+
+        NodeLease(NodeLease &&other) noexcept
+                : graph(other.graph), node(std::exchange(other.node, nullptr)) {}
+
+        inline ~NodeLease() {
+            if (this->node)
+                this->graph->drop(std::exchange(this->node, nullptr));
+        }
+
+        void operator()() {
+            this->graph->execute(std::exchange(this->node, nullptr));
+        }
+
+    public:
+        NodeLease(NodeLease const &other) = delete;
+
+        NodeLease &operator=(NodeLease const &rhs) = delete;
+
+    private:
+        TaskGraph *graph;
+        GraphNode *node;
+    };
+
+    ThreadPool *pool;
+
+    std::vector<std::unique_ptr<GraphNode>> nodes;
+
+    std::atomic<bool> running{false};
+    std::atomic<size_t> remaining_nodes{0};
+
+    // the first exception wins, every node after it is skipped
+    std::atomic<bool> failed{false};
+    std::exception_ptr error{};
+
+    std::shared_ptr<TaskState<void>> completion{};
+
+    bool has_cycle() const;
+
+    ThreadTask make_task(GraphNode *node);
+
+    void execute(GraphNode *node);
+
+    void drop(GraphNode *node);
+
+    void fail(std::exception_ptr exception);
+
+    // returns the successor the caller should run next, if any became ready
+    GraphNode *release_successors(GraphNode *node);
+
+    void node_finished();
+};
+
+#endif //LAB2_TASK_GRAPH_H
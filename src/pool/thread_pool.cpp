@@ -1,58 +1,119 @@
 #include "thread_pool.h"
 
-bool ThreadPool::working() const {
+template <typename Policy>
+bool BasicThreadPool<Policy>::working() const {
     read_lock _(this->common_lock);
     return this->working_unsafe();
 }
 
-bool ThreadPool::alive() const {
+template <typename Policy>
+bool BasicThreadPool<Policy>::alive() const {
     read_lock _(this->common_lock);
     return this->alive_unsafe();
 }
 
-bool ThreadPool::working_unsafe() const {
+template <typename Policy>
+bool BasicThreadPool<Policy>::working_unsafe() const {
     return this->alive_unsafe() && !this->stopped;
 }
 
-bool ThreadPool::alive_unsafe() const {
+template <typename Policy>
+bool BasicThreadPool<Policy>::alive_unsafe() const {
     return this->initialized && !this->terminated;
 }
 
-void ThreadPool::initialize(bool start_immediately) {
+template <typename Policy>
+void BasicThreadPool<Policy>::initialize(bool start_immediately) {
     write_lock _(this->common_lock);
     if (this->initialized || this->terminated)
         return;
 
     this->stopped = !start_immediately;
 
-    for (size_t i = 0; i < this->young_threads_num; i++)
-        this->young_workers[i] = std::thread(&ThreadPool::thread_routine, this, i, true);
+    for (size_t i = 0; i < this->active_young_workers; i++) {
+        this->young_workers[i] = std::thread(&BasicThreadPool::thread_routine, this, i, 0);
+        this->young_workers_running[i] = true;
+    }
+
+    uint32_t thread_id = this->young_threads_num;
+    for (size_t level = 1; level <= this->aged_generations.size(); level++) {
+        auto &generation = this->aged_generations[level - 1];
+
+        for (size_t i = 0; i < generation->level.workers; i++)
+            generation->workers.emplace_back(&BasicThreadPool::thread_routine, this, thread_id++, level);
+    }
+
+    if (this->scaling.min_young_threads < this->scaling.max_young_threads)
+        this->scaler = std::thread(&BasicThreadPool::scaling_routine, this);
 
-    old_worker = std::thread(&ThreadPool::thread_routine, this, this->young_threads_num, false);
+    if (this->promotes())
+        this->promoter = std::thread(&BasicThreadPool::promotion_routine, this);
 
     this->initialized = true;
     this->terminated = false;
-    this->is_last_wish = false;
+    this->draining = false;
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::place_workers(const WorkerAffinity &affinity, size_t workers_num) {
+    auto queues_num = this->young_generation_tasks.size();
+    std::vector<int> queue_nodes(queues_num, 0);
+
+    if (affinity.policy != AffinityPolicy::none) {
+        auto topology = CpuTopology::discover();
+        this->worker_cpus = topology.place(affinity, workers_num);
+
+        // a young heap belongs to the young worker with the same id
+        for (size_t i = 0; i < queues_num; i++)
+            queue_nodes[i] = this->worker_cpus[i] < 0 ? -1 : topology.node_of(this->worker_cpus[i]);
+    }
+
+    this->steal_victims.resize(queues_num);
+
+    for (size_t thread_id = 0; thread_id < queues_num; thread_id++) {
+        auto &victims = this->steal_victims[thread_id];
+
+        for (size_t i = 1; i < queues_num; i++)
+            victims.push_back((thread_id + i) % queues_num);
+
+        std::stable_partition(victims.begin(), victims.end(), [&](uint32_t victim) {
+            return queue_nodes[victim] == queue_nodes[thread_id];
+        });
+    }
 }
 
-void ThreadPool::terminate(bool finish_tasks_in_queue) {
+template <typename Policy>
+void BasicThreadPool<Policy>::terminate(bool finish_tasks_in_queue) {
+    if (finish_tasks_in_queue && this->alive()) {
+        // a paused or never started pool would not get any closer to idle
+        this->resume();
+
+        // workers keep running and parking as usual, the last task to finish wakes the drain
+        this->draining = true;
+        this->drain();
+    }
+
     {
         write_lock _(this->common_lock);
+        this->draining = false;
+
         if (!alive_unsafe())
             return;
 
-        this->is_last_wish = finish_tasks_in_queue;
-
-        if (this->is_last_wish) {
-            while (!this->young_generation_tasks.empty() && !this->old_generation_tasks.empty()) {
-                this->last_wish_waiter.wait(_);
-            }
-        }
-
         this->initialized = false;
         this->terminated = true;
-        this->young_task_waiter.notify_all();
-        this->old_task_waiter.notify_all();
+        for (uint32_t level = 0; level < this->get_levels_num(); level++)
+            this->wake_all_workers(level);
+        this->scaler_waiter.notify_all();
+
+        write_lock _p(this->promotion_lock);
+        this->promoter_waiter.notify_all();
+
+        write_lock _a(this->admission_lock);
+        this->admission_waiter.notify_all();
+
+        write_lock _i(this->idle_lock);
+        this->idle_waiter.notify_all();
     }
     {
         write_lock _p(this->pause_lock);
@@ -61,163 +122,788 @@ void ThreadPool::terminate(bool finish_tasks_in_queue) {
         this->pause_waiter.notify_all();
     }
 
+    if (this->scaler.joinable())
+        this->scaler.join();
+
+    if (this->promoter.joinable())
+        this->promoter.join();
+
     for (size_t i = 0; i < this->young_threads_num; i++)
-        this->young_workers[i].join();
+        if (this->young_workers[i].joinable())
+            this->young_workers[i].join();
 
-    this->old_worker.join();
+    for (auto &generation: this->aged_generations)
+        for (auto &worker: generation->workers)
+            worker.join();
 
     this->stopped = true;
 
-    write_lock _(stdout_lock);
-    std::cout << terminal.red << "The thread pool terminated\n" << terminal.reset;
+    LOG_INFO(terminal.red, "The thread pool terminated\n");
 }
 
-bool ThreadPool::get_task_from_queue(PoolQueue *queue, std::shared_ptr<ThreadTask> &out_task, bool is_young) {
-    write_lock _(this->common_lock);
-    bool fell_to_sleep = false, task_obtained = false;
+template <typename Policy>
+bool BasicThreadPool<Policy>::steal_task(uint32_t thread_id, TaskHandle &out_task, bool is_young) {
+    auto queues_num = this->young_generation_tasks.size();
+
+    // a young worker has already looked into its own heap and goes through its NUMA node first
+    for (size_t i = 0; i < (is_young ? queues_num - 1 : queues_num); i++) {
+        auto victim_id = is_young ? this->steal_victims[thread_id % queues_num][i] : (thread_id + i) % queues_num;
+        auto victim = this->young_generation_tasks[victim_id].get();
+
+        bool stolen = victim->pop(out_task);
+        this->telemetry.steal_attempted(stolen);
 
-    auto wait_condition = [&]() {
-        do {
-            task_obtained = queue->pop(out_task);
+        if (stolen)
+            return true;
+    }
+
+    return false;
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::help_aged_generations(uint32_t own_level, TaskHandle &out_task) {
+    // the oldest tasks have been waiting the longest
+    for (auto level = this->aged_generations.size(); level > 0; level--)
+        if (level != own_level && this->aged_generations[level - 1]->tasks->pop(out_task))
+            return true;
+
+    return false;
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::try_obtain_task(uint32_t thread_id, TaskHandle &out_task, uint32_t level) {
+    if (level == 0)
+        return this->local_queue(thread_id)->pop(out_task) || this->steal_task(thread_id, out_task, true)
+               || this->help_aged_generations(level, out_task);
+
+    return this->aged_generations[level - 1]->tasks->pop(out_task) || this->help_aged_generations(level, out_task)
+           || this->steal_task(thread_id, out_task, false);
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::get_task_from_queue(uint32_t thread_id, TaskHandle &out_task, uint32_t level) {
+    auto dequeue_start = Clock::now();
+    bool is_young = level == 0;
+
+    if (!this->terminated && this->try_obtain_task(thread_id, out_task, level)) {
+        this->telemetry.update_dequeue_time(Clock::now() - dequeue_start);
+        return true;
+    }
 
-            // if this task is in the queue but marked as IN_PROGRESS
-        } while (task_obtained && out_task->is_in_progress);
+    auto &idle_workers = this->idle_workers(level);
+    auto &parker = this->parkers[thread_id];
 
-        bool continue_straight_away = this->terminated || task_obtained || this->is_last_wish;
-        fell_to_sleep = !continue_straight_away;
+    bool fell_to_sleep = false, woken = false, task_obtained = false;
+    std::chrono::microseconds time_asleep{0};
 
-        return continue_straight_away;
+    // true once the worker has a task or should stop looking for one
+    auto look_for_task = [&]() {
+        bool retired = is_young && this->young_worker_retired(thread_id);
+        task_obtained = !this->terminated && !retired && this->try_obtain_task(thread_id, out_task, level);
+
+        return this->terminated || task_obtained || retired;
     };
 
-    auto millis_passed = measure_execution_time([&]() {
-        this->current_monitor(is_young)->wait(_, wait_condition);
-    });
+    while (!look_for_task()) {
+        woken = false;
+        parker.prepare();
+        idle_workers.push(thread_id);
 
-    if (this->terminated || !task_obtained) {
-        if (this->is_last_wish) {
-            this->last_wish_waiter.notify_one();
+        // a task published before the push is found here, one published after it finds the worker on the stack
+        if (look_for_task()) {
+            // a waker that got to the worker first meant its wakeup for some task, whether the worker
+            // took another one or was retired that wakeup goes to somebody else
+            if (!idle_workers.remove(thread_id) && !this->terminated)
+                this->wake_workers(level, 1);
+
+            break;
         }
-        return false;
+
+        fell_to_sleep = true;
+        TRACE_EVENT(park, nullptr, 0);
+
+        time_asleep += measure_execution_time<std::chrono::microseconds>([&]() {
+            parker.park();
+        });
+
+        TRACE_EVENT(unpark, nullptr, 0);
+        woken = true;
     }
 
+    // the same goes for a worker that finds it was retired right after a wakeup
+    if (woken && !this->terminated && !task_obtained)
+        this->wake_workers(level, 1);
+
+    if (this->terminated || !task_obtained)
+        return false;
+
     if (fell_to_sleep) {
-        this->telemetry.update_wait_time(millis_passed);
+        this->telemetry.update_wait_time(time_asleep);
+    } else {
+        this->telemetry.update_dequeue_time(Clock::now() - dequeue_start);
     }
 
-    this->telemetry.update_main_queue_size(this->young_generation_tasks.size() + this->old_generation_tasks.size());
-
-    if (out_task)
-        out_task->is_in_progress = true;
+    this->telemetry.update_main_queue_size(this->currently_scheduled_tasks() + this->currently_aged_tasks());
 
-    return out_task != nullptr;
+    return static_cast<bool>(out_task);
 }
 
-void ThreadPool::thread_routine(uint32_t thread_id, bool is_young) {
-    auto queue = this->current_queue(is_young);
+template <typename Policy>
+void BasicThreadPool<Policy>::thread_routine(uint32_t thread_id, uint32_t level) {
+    bool is_young = level == 0;
+    worker_of = this;
+
+    Tracer::name_current_thread("worker " + std::to_string(thread_id) + " (level " + std::to_string(level) + ")");
+
+    if (thread_id < this->worker_cpus.size() && this->worker_cpus[thread_id] >= 0
+        && !CpuTopology::pin_current_thread(this->worker_cpus[thread_id]))
+        LOG_WARNING(terminal.yellow, "Thread {%llu}. Could not be pinned to CPU {%lld}\n",
+                    thread_id, static_cast<long long>(this->worker_cpus[thread_id]));
 
     while (true) {
-        std::shared_ptr<ThreadTask> task{};
+        TaskHandle task{};
 
         this->check_pause();
 
-        this->review_young_generation();
+        if (is_young && this->young_worker_retired(thread_id) && this->retire_young_worker(thread_id))
+            return;
+
+        this->review_promotions();
+
+        if (!this->get_task_from_queue(thread_id, task, level)) {
+            // a worker that was retired and brought back before it got to leave keeps going
+            if (is_young && !this->retire_young_worker(thread_id))
+                continue;
 
-        if (!this->get_task_from_queue(queue, task, is_young))
             return;
+        }
+
+        this->release_slots(1);
+        TRACE_EVENT(dequeue, task.get(), task->id, level);
+
+        if constexpr (Policy::virtual_time)
+            this->fair_share.advance(task->virtual_finish);
 
         this->check_pause();
 
-        {
-            read_lock _(this->common_lock);
-            if (is_young)
-                this->telemetry.update_main_queue_size(queue->size());
-            else
-                this->telemetry.update_secondary_queue_size(queue->size());
-        }
+        if (is_young)
+            this->telemetry.update_main_queue_size(this->currently_scheduled_tasks());
+        else
+            this->telemetry.update_secondary_queue_size(this->currently_aged_tasks());
 
-        {
-            write_lock _(stdout_lock);
-            std::cout << terminal.yellow << "Thread {" << thread_id << "}. Task {" << task->id << "} - Start\n"
-                      << terminal.reset;
+        if (task->deadline <= Clock::now()) {
+            this->telemetry.task_expired();
+            TRACE_EVENT(expire, task.get(), task->id, level);
+
+            LOG_DEBUG(terminal.red, "Thread {%llu}. Task {%llu} - Expired\n", thread_id, task->id);
+
+            task = TaskHandle{};
+            this->finish_tasks(1);
+            continue;
         }
 
-        auto task_execution_time = measure_execution_time([&]() {
+        this->telemetry.update_queue_wait(std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - task->creation_point));
+
+        LOG_DEBUG(terminal.yellow, "Thread {%llu}. Task {%llu} - Start\n", thread_id, task->id);
+
+        TRACE_EVENT(start, task.get(), task->id, level);
+
+        auto task_execution_time = measure_execution_time<std::chrono::microseconds>([&]() {
             task->operator()();
         });
 
-        {
-            write_lock _(stdout_lock);
-            std::cout << terminal.green << "Thread {" << thread_id << "}. Task {" << task->id << "} - Finish in "
-                      << task_execution_time.count() << " ms\n"
-                      << terminal.reset;
-        }
+        TRACE_EVENT(finish, task.get(), task->id, level);
+
+        LOG_DEBUG(terminal.green, "Thread {%llu}. Task {%llu} - Finish in %lld ms\n",
+                  thread_id, task->id, task_execution_time.count() / 1000);
+
+        this->telemetry.task_completed(task_execution_time);
 
-        this->telemetry.task_completed(task_execution_time.count());
+        // whatever the task holds is released before a drain can see the pool idle
+        task = TaskHandle{};
+        this->finish_tasks(1);
     }
 }
 
-void ThreadPool::review_young_generation() {
+template <typename Policy>
+bool BasicThreadPool<Policy>::retire_young_worker(uint32_t thread_id) {
+    write_lock _(this->common_lock);
+
+    if (!this->terminated && !this->young_worker_retired(thread_id))
+        return false;
+
+    this->young_workers_running[thread_id] = false;
+    return true;
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::scale_young_workers(int32_t change) {
     write_lock _(this->common_lock);
+    if (this->terminated)
+        return;
+
+    auto active = this->active_young_workers.load();
+
+    if (change > 0 && active < this->scaling.max_young_threads) {
+        // a worker that has not left yet simply sees that it is active again
+        if (!this->young_workers_running[active]) {
+            if (this->young_workers[active].joinable())
+                this->young_workers[active].join();
+
+            this->young_workers[active] = std::thread(&BasicThreadPool::thread_routine, this, active, 0);
+            this->young_workers_running[active] = true;
+        }
+
+        this->active_young_workers = active + 1;
+    } else if (change < 0 && active > this->scaling.min_young_threads) {
+        // whatever is left in its heap gets stolen by the others
+        this->active_young_workers = active - 1;
+        this->wake_all_workers(0);
+    } else {
+        return;
+    }
+
+    LOG_INFO(terminal.cyan, "Young workers scaled to {%llu}\n", this->active_young_workers.load());
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::scaling_routine() {
+    uint32_t overloaded_reviews = 0, underloaded_reviews = 0;
+    auto previous = this->telemetry.snapshot();
+
+    while (true) {
+        uint32_t idle_workers;
+        {
+            write_lock _(this->common_lock);
+            this->scaler_waiter.wait_for(_, Clock::to_real(this->scaling.review_interval),
+                                         [this]() { return this->terminated.load(); });
 
-    for (size_t i = 0; i < this->young_generation_tasks.size(); i++) {
-        auto task = this->young_generation_tasks.at(i);
+            if (this->terminated)
+                return;
 
-        bool valid_task = !task->is_in_progress && !task->is_moved;
-        bool wait_time_passed = std::chrono::high_resolution_clock::now() > task->creation_point + task->wait_time * 2;
+            idle_workers = this->young_idle_workers.size();
+        }
+
+        auto current = this->telemetry.snapshot();
+        auto active = this->active_young_workers.load();
+
+        auto queued_per_worker = (double) this->currently_scheduled_tasks() / active;
+
+        // sleep time is only reported on wakeup, so workers asleep right now are counted separately
+        auto slept_us = (double) (current.total_sleep_time_us - previous.total_sleep_time_us);
+        auto interval_us = (double) std::chrono::duration_cast<std::chrono::microseconds>(
+                this->scaling.review_interval).count();
+        auto sleep_ratio = std::max(slept_us / (interval_us * active), (double) idle_workers / active);
 
-        if (valid_task && wait_time_passed) {
-            task->is_moved = true;
-            this->old_generation_tasks.push(task);
-            this->old_task_waiter.notify_one();
+        previous = current;
 
-            {
-                write_lock _s(stdout_lock);
-                std::cout << terminal.blue << "Task {" << task->id << "}. Moved to older queue\n" << terminal.reset;
-            }
+        overloaded_reviews = queued_per_worker > this->scaling.scale_up_queue_per_worker ? overloaded_reviews + 1 : 0;
+        underloaded_reviews = queued_per_worker == 0 && sleep_ratio > this->scaling.scale_down_sleep_ratio
+                              ? underloaded_reviews + 1 : 0;
+
+        if (overloaded_reviews >= this->scaling.hysteresis_reviews) {
+            this->scale_young_workers(1);
+            overloaded_reviews = 0;
+        } else if (underloaded_reviews >= this->scaling.hysteresis_reviews) {
+            this->scale_young_workers(-1);
+            underloaded_reviews = 0;
         }
     }
 }
 
-void ThreadPool::add_task(const ThreadTask &task) {
-    if (!alive())
+template <typename Policy>
+void BasicThreadPool<Policy>::promotion_routine() {
+    Tracer::name_current_thread("promoter");
+
+    write_lock _(this->promotion_lock);
+
+    // terminate notifies under promotion_lock, so the flag is checked before every wait
+    while (!this->terminated) {
+        auto due = this->promoter_wakeup = this->promotion_timers.next_due();
+        auto now = Clock::now();
+
+        if (due == Clock::time_point::max())
+            this->promoter_waiter.wait(_);
+        else if (due > now)
+            this->promoter_waiter.wait_for(_, Clock::to_real(due - now));
+
+        this->promoter_wakeup = Clock::time_point::max();
+        if (this->terminated)
+            return;
+
+        // a worker reviewing at the same time does it for the promoter
+        _.unlock();
+        this->review_promotions();
+        _.lock();
+    }
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::review_promotions() {
+    write_lock _(this->promotion_lock, std::try_to_lock);
+    if (!_.owns_lock())
         return;
 
-    write_lock _(this->common_lock);
-    this->young_generation_tasks.push(const_cast<ThreadTask &>(task));
-    this->telemetry.add_task();
+    std::vector<std::pair<TaskHandle, uint32_t>> promoted;
 
+    this->promotion_timers.advance(Clock::now(), [&](PromotionTimer &timer) {
+        // the task sits in the heap of the level below unless it was taken in the meantime
+        TaskHandle task;
+        if (!this->take_queued_task(timer.ticket, task))
+            return;
+
+        this->aged_generations[timer.level - 1]->tasks->push(task);
+        TRACE_EVENT(promote, task.get(), task->id, timer.level);
+
+        LOG_DEBUG(terminal.blue, "Task {%llu}. Moved to level {%llu}\n", task->id, timer.level);
+
+        promoted.emplace_back(std::move(task), timer.level);
+    });
+
+    if (promoted.empty())
+        return;
+
+    // scheduled once the wheel is done advancing, a deadline that is already due fires on the next review
+    for (auto &[task, level]: promoted)
+        if (level < this->aged_generations.size())
+            this->schedule_promotion(task, level + 1);
+
+    for (uint32_t level = 1; level <= this->aged_generations.size(); level++) {
+        auto tasks_num = std::count_if(promoted.begin(), promoted.end(), [level](const auto &promotion) {
+            return promotion.second == level;
+        });
+
+        if (tasks_num > 0)
+            this->wake_workers(level, tasks_num);
+    }
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::drop_queued_tasks() {
+    TaskHandle task;
+
+    for (auto &queue: this->young_generation_tasks)
+        while (queue->pop(task)) {
+            TRACE_EVENT(reject, task.get(), task->id);
+            task = TaskHandle{};
+            this->finish_tasks(1);
+        }
+
+    for (auto &generation: this->aged_generations)
+        while (generation->tasks->pop(task)) {
+            TRACE_EVENT(reject, task.get(), task->id);
+            task = TaskHandle{};
+            this->finish_tasks(1);
+        }
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::schedule_promotion(const TaskHandle &task, uint32_t level) {
+    auto waited = std::chrono::duration_cast<Clock::duration>(
+            task->wait_time * this->aged_generations[level - 1]->level.aging_factor);
+
+    auto due = task->creation_point + waited;
+    this->promotion_timers.schedule(due, PromotionTimer{this->ticket_of(task), level});
+
+    if (due < this->promoter_wakeup) {
+        this->promoter_wakeup = due;
+        this->promoter_waiter.notify_one();
+    }
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::take_queued_task(const TaskTicket &ticket, TaskHandle &out_task) {
+    if (!ticket)
+        return false;
+
+    if constexpr (!Queue::erasable) {
+        return false;
+    } else {
+        // slab nodes are never freed, so the pointer stays readable even if the task is long gone
+        auto queue = static_cast<Queue *>(ticket.task->heap_hook.owner.load(std::memory_order_acquire));
+
+        while (queue) {
+            if (queue->erase_if(ticket.task, [&ticket](const ThreadTask &node) {
+                return node.intrusive_hook.generation.load(std::memory_order_acquire) == ticket.generation;
+            }, out_task))
+                return true;
+
+            // moved to another heap between the load and the lock, it is looked for there
+            auto owner = static_cast<Queue *>(ticket.task->heap_hook.owner.load(std::memory_order_acquire));
+            if (owner == queue)
+                return false;
+
+            queue = owner;
+        }
+
+        return false;
+    }
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::cancel(const TaskTicket &ticket) {
+    TaskHandle task;
     {
-        write_lock _s(stdout_lock);
-        std::cout << terminal.magenta << "Task {" << task.id << "}. Added to pool\n" << terminal.reset;
+        // a promotion leaves the task in no heap for a moment, a cancel in between would miss it
+        read_lock _p(this->promotion_lock, std::defer_lock);
+        if (this->promotes())
+            _p.lock();
+
+        if (!this->take_queued_task(ticket, task))
+            return false;
+    }
+
+    this->release_slots(1);
+    this->finish_tasks(1);
+    this->telemetry.task_cancelled();
+    TRACE_EVENT(cancel, task.get(), task->id);
+
+    LOG_DEBUG(terminal.red, "Task {%llu}. Cancelled\n", task->id);
+
+    return true;
+}
+
+template <typename Policy>
+TaskTicket BasicThreadPool<Policy>::add_task(ThreadTask &&task) {
+    bool taken;
+    return this->admit_task(std::move(task), this->admission.overflow, taken);
+}
+
+template <typename Policy>
+TaskTicket BasicThreadPool<Policy>::try_add_task(ThreadTask &&task) {
+    bool taken;
+    return this->admit_task(std::move(task), OverflowPolicy::reject, taken);
+}
+
+template <typename Policy>
+TaskTicket BasicThreadPool<Policy>::admit_task(ThreadTask &&task, OverflowPolicy overflow, bool &taken) {
+    taken = false;
+
+    if (!this->accepts_tasks()) {
+        this->telemetry.tasks_rejected();
+        return TaskTicket{};
+    }
+
+    this->stamp(task);
+
+    // a worker waiting for room in its own pool could be waiting for itself
+    if (overflow == OverflowPolicy::block && worker_of == this)
+        overflow = OverflowPolicy::caller_runs;
+
+    if (this->reserve_slots(1) == 0) {
+        bool admitted = false;
+
+        switch (overflow) {
+            case OverflowPolicy::block:
+                admitted = this->wait_for_slot();
+                break;
+            case OverflowPolicy::reject:
+                break;
+            case OverflowPolicy::drop_lowest:
+                admitted = this->evict_lower_than(task);
+                break;
+            case OverflowPolicy::caller_runs:
+                this->run_on_caller(std::move(task));
+                taken = true;
+                return TaskTicket{};
+        }
+
+        if (!admitted) {
+            this->telemetry.tasks_rejected();
+
+            LOG_DEBUG(terminal.red, "Task {%llu}. Rejected\n", task.id);
+            return TaskTicket{};
+        }
+    }
+
+    bool reused;
+    auto scheduled_task = this->task_allocator.make(std::move(task), reused);
+    this->telemetry.tasks_allocated(1, reused);
+
+    // before the push, so that a worker cannot trace the dequeue first
+    TRACE_EVENT(enqueue, scheduled_task.get(), scheduled_task->id);
+    this->outstanding_tasks.fetch_add(1, std::memory_order_relaxed);
+
+    if (!this->push_young_task(scheduled_task)) {
+        TRACE_EVENT(reject, scheduled_task.get(), scheduled_task->id);
+        this->release_slots(1);
+        this->finish_tasks(1);
+        this->telemetry.tasks_rejected();
+
+        // handed back untouched, as any task the pool refuses
+        task = std::move(*scheduled_task);
+        return TaskTicket{};
+    }
+
+    taken = true;
+    this->telemetry.add_task();
+
+    if (this->promotes()) {
+        write_lock _p(this->promotion_lock);
+        this->schedule_promotion(scheduled_task, 1);
     }
 
-    this->young_task_waiter.notify_one();
+    LOG_DEBUG(terminal.magenta, "Task {%llu}. Added to pool\n", scheduled_task->id);
+
+    this->wake_workers(0, 1);
+
+    return this->ticket_of(scheduled_task);
 }
 
-void ThreadPool::pause() {
+template <typename Policy>
+size_t BasicThreadPool<Policy>::add_tasks_batch(std::vector<TaskHandle> &batch) {
+    if (batch.empty())
+        return 0;
+
+    if (!this->accepts_tasks()) {
+        this->telemetry.tasks_rejected(batch.size());
+        return 0;
+    }
+
+    for (auto &task: batch)
+        TRACE_EVENT(enqueue, task.get(), task->id);
+
+    this->outstanding_tasks.fetch_add(batch.size(), std::memory_order_relaxed);
+
+    auto first_id = batch.front()->id, last_id = batch.back()->id;
+
+    // contiguous slices, so every young heap is locked and heapified once
+    auto queues_num = std::min<size_t>(this->young_generation_tasks.size(), this->active_young_workers);
+    auto slice = (batch.size() + queues_num - 1) / queues_num;
+
+    size_t accepted = 0;
+    for (size_t begin = 0; begin < batch.size(); begin += slice) {
+        auto end = std::min(begin + slice, batch.size());
+        auto queue = this->local_queue(this->next_active_queue());
+
+        if constexpr (Queue::bounded) {
+            // what does not fit stays in the batch
+            auto pushed = queue->push_bulk(batch.begin() + begin, batch.begin() + end);
+            std::fill(batch.begin() + begin, batch.begin() + begin + pushed, TaskHandle{});
+            accepted += pushed;
+        } else {
+            queue->push_bulk(batch.begin() + begin, batch.begin() + end);
+            accepted += end - begin;
+        }
+    }
+
+    if (accepted < batch.size()) {
+        // only the refused tasks are still in the batch
+        for (auto &task: batch)
+            if (task)
+                TRACE_EVENT(reject, task.get(), task->id);
+
+        this->finish_tasks(batch.size() - accepted);
+        this->telemetry.tasks_rejected(batch.size() - accepted);
+    }
+
+    if (accepted == 0)
+        return 0;
+
+    this->telemetry.add_task(accepted);
+
+    if (this->promotes()) {
+        write_lock _p(this->promotion_lock);
+        for (auto &task: batch)
+            this->schedule_promotion(task, 1);
+    }
+
+    if constexpr (!Queue::bounded)
+        std::fill(batch.begin(), batch.end(), TaskHandle{});
+
+    LOG_DEBUG(terminal.magenta, "Tasks {%llu..%llu}. Added to pool\n", first_id, last_id);
+
+    this->wake_workers(0, accepted);
+
+    return accepted;
+}
+
+template <typename Policy>
+uint32_t BasicThreadPool<Policy>::reserve_slots(uint32_t wanted) {
+    if (this->admission.capacity == 0) {
+        this->admitted_tasks.fetch_add(wanted, std::memory_order_seq_cst);
+        return wanted;
+    }
+
+    auto admitted = this->admitted_tasks.load(std::memory_order_seq_cst);
+    uint32_t granted;
+
+    do {
+        granted = admitted < this->admission.capacity ? std::min(wanted, this->admission.capacity - admitted) : 0;
+        if (granted == 0)
+            return 0;
+    } while (!this->admitted_tasks.compare_exchange_weak(admitted, admitted + granted, std::memory_order_seq_cst));
+
+    return granted;
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::release_slots(uint32_t released) {
+    this->admitted_tasks.fetch_sub(released, std::memory_order_seq_cst);
+
+    // pairs with wait_for_slot: either the producer sees the free slot or this sees the producer
+    if (this->blocked_producers.load(std::memory_order_seq_cst) == 0)
+        return;
+
+    write_lock _(this->admission_lock);
+
+    if (released == 1)
+        this->admission_waiter.notify_one();
+    else
+        this->admission_waiter.notify_all();
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::wait_for_slot() {
+    write_lock _(this->admission_lock);
+    this->blocked_producers.fetch_add(1, std::memory_order_seq_cst);
+
+    bool reserved = false;
+    this->admission_waiter.wait(_, [&]() {
+        return this->terminated || (reserved = this->reserve_slots(1) > 0);
+    });
+
+    this->blocked_producers.fetch_sub(1, std::memory_order_relaxed);
+
+    return reserved;
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::finish_tasks(uint32_t finished) {
+    // pairs with wait_until_idle the same way release_slots pairs with wait_for_slot
+    if (this->outstanding_tasks.fetch_sub(finished, std::memory_order_seq_cst) != finished
+        || this->idle_waiters.load(std::memory_order_seq_cst) == 0)
+        return;
+
+    write_lock _(this->idle_lock);
+    this->idle_waiter.notify_all();
+}
+
+template <typename Policy>
+template <typename Wait>
+bool BasicThreadPool<Policy>::wait_until_idle(Wait &&wait) {
+    // a worker's own task is outstanding until it returns
+    if (worker_of == this)
+        return false;
+
+    write_lock _(this->idle_lock);
+    this->idle_waiters.fetch_add(1, std::memory_order_seq_cst);
+
+    bool idle = false;
+    wait(_, [&]() {
+        return (idle = this->outstanding_tasks.load(std::memory_order_seq_cst) == 0) || this->terminated;
+    });
+
+    this->idle_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    return idle;
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::wait_idle(std::chrono::milliseconds timeout) {
+    return this->wait_until_idle([&](write_lock &lock, auto &&idle) {
+        this->idle_waiter.wait_for(lock, timeout, idle);
+    });
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::drain() {
+    return this->wait_until_idle([&](write_lock &lock, auto &&idle) {
+        this->idle_waiter.wait(lock, idle);
+    });
+}
+
+template <typename Policy>
+bool BasicThreadPool<Policy>::evict_lower_than(const ThreadTask &task) {
+    if constexpr (!Queue::erasable) {
+        return false;
+    } else {
+        // the lowest task of the first young heap that holds one running after the new task, not of the whole pool
+        TaskHandle evicted;
+        for (size_t i = 0; i < this->young_generation_tasks.size() && !evicted; i++)
+            this->young_generation_tasks[i]->erase_lowest_if([&task](const ThreadTask &queued) {
+                return Policy::runs_after(queued, task);
+            }, evicted);
+
+        if (!evicted)
+            return false;
+
+        this->finish_tasks(1);
+        this->telemetry.task_evicted();
+        TRACE_EVENT(cancel, evicted.get(), evicted->id);
+
+        LOG_DEBUG(terminal.red, "Task {%llu}. Evicted for task {%llu}\n", evicted->id, task.id);
+        return true;
+    }
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::run_on_caller(ThreadTask &&task) {
+    auto executable = std::move(task.executable);
+
+    if (task.deadline <= Clock::now()) {
+        this->telemetry.task_expired();
+        return;
+    }
+
+    LOG_DEBUG(terminal.yellow, "Task {%llu}. Runs on the caller's thread\n", task.id);
+
+    TRACE_EVENT(start, nullptr, task.id);
+    executable();
+    TRACE_EVENT(finish, nullptr, task.id);
+
+    this->telemetry.task_run_by_caller();
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::wake_workers(uint32_t level, size_t tasks_num) {
+    auto levels_num = this->get_levels_num();
+
+    for (uint32_t i = 0; i < levels_num && tasks_num > 0; i++) {
+        tasks_num -= this->idle_workers((level + i) % levels_num).wake(tasks_num, [this](uint32_t worker) {
+            this->parkers[worker].unpark();
+        });
+    }
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::wake_all_workers(uint32_t level) {
+    // everyone woken re-checks whether it was retired or the pool terminated
+    this->idle_workers(level).wake(std::numeric_limits<size_t>::max(), [this](uint32_t worker) {
+        this->parkers[worker].unpark();
+    });
+}
+
+template <typename Policy>
+void BasicThreadPool<Policy>::pause() {
     write_lock _(this->pause_lock);
     this->stopped = true;
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.red << "The thread pool stopped\n" << terminal.reset;
+    LOG_INFO(terminal.red, "The thread pool stopped\n");
 }
 
-void ThreadPool::start() {
+template <typename Policy>
+void BasicThreadPool<Policy>::start() {
     if (this->working()) return;
 
     write_lock _(this->pause_lock);
     this->stopped = false;
     this->pause_waiter.notify_all();
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.cyan << "The thread pool started\n" << terminal.reset;
+    LOG_INFO(terminal.cyan, "The thread pool started\n");
 }
 
-void ThreadPool::resume() {
+template <typename Policy>
+void BasicThreadPool<Policy>::resume() {
     write_lock _(this->pause_lock);
     this->stopped = false;
     this->pause_waiter.notify_all();
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.cyan << "The thread pool resumed\n" << terminal.reset;
+    LOG_INFO(terminal.cyan, "The thread pool resumed\n");
 }
+
+template class BasicThreadPool<ShortestJobFirst>;
+template class BasicThreadPool<FirstInFirstOut>;
+template class BasicThreadPool<EarliestDeadlineFirst>;
+template class BasicThreadPool<WeightedFairQueuing>;
@@ -2,22 +2,152 @@
 #define LAB2_THREAD_POOL_H
 
 #include "helper.h"
-#include "concurrent_queue.h"
-
+#include "logger.h"
+#include "tracer.h"
+#include "scheduling_policy.h"
+#include "timer_wheel.h"
+#include "task_future.h"
+#include "slab_allocator.h"
+#include "cpu_topology.h"
+#include "parker.h"
+
+#include <algorithm>
 #include <condition_variable>
+#include <limits>
+#include <vector>
+
+#ifdef LAB2_COROUTINES
+template <typename Pool>
+class ScheduleAwaitable;
+
+template <typename R>
+class PoolTask;
+#endif
 
-typedef PriorityQueue<ThreadTask> PoolQueue;
+// Weak reference to a queued task, stale once the node was recycled
+struct TaskTicket {
+    const ThreadTask *task = nullptr;
+    uint32_t generation = 0;
+
+    explicit operator bool() const {
+        return this->task != nullptr;
+    }
+};
+
+struct PromotionTimer {
+    TaskTicket ticket;
+    // the level the task moves up to, 1 is the first one above the young generation
+    uint32_t level;
+};
+
+// shared_queue keeps one young heap shared by all workers and exists to compare against work_stealing
+enum class YoungQueueMode {
+    shared_queue,
+    work_stealing
+};
+
+// Bounds and thresholds for the young worker autoscaler, min == max keeps the count fixed
+struct ElasticScaling {
+    uint32_t min_young_threads = 1;
+    uint32_t max_young_threads = 1;
+
+    std::chrono::milliseconds review_interval{500};
+
+    // queued young tasks per active worker that count as overload
+    double scale_up_queue_per_worker = 2.0;
+    // share of the interval the active workers spent asleep that counts as underload
+    double scale_down_sleep_ratio = 0.5;
+    // consecutive reviews a signal has to hold before the worker count changes
+    uint32_t hysteresis_reviews = 3;
+};
+
+// One feedback level above the young generation. A task moves up to it once it has waited
+// wait_time * aging_factor since it was created, so the factors have to grow level by level.
+struct AgingLevel {
+    double aging_factor = 2.0;
+    // workers that serve this level first and only help the others when it is empty
+    uint32_t workers = 1;
+};
+
+// What add_task does once capacity tasks are queued and no worker has taken them yet
+enum class OverflowPolicy {
+    // waits until a worker takes a task, a pool worker runs the task itself instead of waiting on its pool
+    block,
+    // refuses the task, as try_add_task does under any policy
+    reject,
+    // evicts a queued young task the policy runs after this one or refuses this one, reject for FirstInFirstOut
+    drop_lowest,
+    // runs the task on the producer's thread right away
+    caller_runs
+};
+
+struct AdmissionControl {
+    // 0 admits without limit
+    uint32_t capacity = 0;
+    OverflowPolicy overflow = OverflowPolicy::reject;
+    // slots of every young MpmcRing of a FirstInFirstOut pool, rounded up to a power of two.
+    // Once the rings are full they refuse tasks whatever the capacity above, heaps grow as needed.
+    size_t ring_capacity = MpmcRing<TaskHandle>::default_capacity;
+};
+
+// Policy orders the tasks of every level, see scheduling_policy.h. Heap policies queue into an
+// IndexedPriorityQueue, which supports promotion and cancellation, FirstInFirstOut trades both
+// for the lock-free throughput of an MpmcRing. The pool is instantiated for every policy in thread_pool.cpp.
+template <typename Policy>
+class BasicThreadPool {
+    typedef typename PolicyQueue<Policy>::type Queue;
 
-class ThreadPool {
 public:
-    inline explicit ThreadPool(uint32_t main_threads_num, bool start_immediately = false) {
-        this->young_threads_num = main_threads_num;
+    inline explicit BasicThreadPool(uint32_t main_threads_num, bool start_immediately = false,
+                               YoungQueueMode queue_mode = YoungQueueMode::work_stealing,
+                               const std::vector<AgingLevel> &aging_levels = {AgingLevel{}},
+                               const WorkerAffinity &affinity = WorkerAffinity{},
+                               const AdmissionControl &admission = AdmissionControl{})
+            : BasicThreadPool(ElasticScaling{main_threads_num, main_threads_num}, start_immediately, queue_mode,
+                         aging_levels, affinity, admission) {}
+
+    inline explicit BasicThreadPool(const ElasticScaling &scaling, bool start_immediately = false,
+                               YoungQueueMode queue_mode = YoungQueueMode::work_stealing,
+                               const std::vector<AgingLevel> &aging_levels = {AgingLevel{}},
+                               const WorkerAffinity &affinity = WorkerAffinity{},
+                               const AdmissionControl &admission = AdmissionControl{}) {
+        this->scaling = scaling;
+        this->scaling.max_young_threads = std::max(1u, scaling.max_young_threads);
+        this->scaling.min_young_threads = std::clamp(scaling.min_young_threads, 1u, this->scaling.max_young_threads);
+
+        this->young_threads_num = this->scaling.max_young_threads;
+        this->active_young_workers = this->scaling.min_young_threads;
+        this->queue_mode = queue_mode;
+        this->admission = admission;
         this->young_workers = std::make_unique<std::thread[]>(this->young_threads_num);
+        this->young_workers_running = std::make_unique<bool[]>(this->young_threads_num);
+
+        uint32_t young_queues_num = queue_mode == YoungQueueMode::work_stealing ? this->young_threads_num : 1;
+        for (size_t i = 0; i < young_queues_num; i++)
+            this->young_generation_tasks.push_back(this->make_queue());
+
+        double aging_factor = 0;
+        for (auto level: aging_levels) {
+            level.aging_factor = aging_factor = std::max(level.aging_factor, aging_factor);
+            this->aged_generations.push_back(std::make_unique<AgedGeneration>(level, this->make_queue()));
+        }
+
+        size_t workers_num = this->young_threads_num;
+        for (auto &generation: this->aged_generations)
+            workers_num += generation->level.workers;
+
+        this->parkers = std::make_unique<Parker[]>(workers_num);
+
+        this->place_workers(affinity, workers_num);
 
         this->initialize(start_immediately);
     }
 
-    inline ~ThreadPool() { terminate(); }
+    inline ~BasicThreadPool() {
+        terminate();
+        // while the pool is still whole, tasks that release something on drop may call back into it
+        this->drop_queued_tasks();
+    }
 
 public:
     bool working() const;
@@ -29,12 +159,98 @@ public:
     bool alive_unsafe() const;
 
     uint32_t currently_scheduled_tasks() const {
-        read_lock _(this->common_lock);
-        return this->young_generation_tasks.size();
+        uint32_t scheduled = 0;
+        for (auto &queue: this->young_generation_tasks)
+            scheduled += queue->size();
+
+        return scheduled;
+    }
+
+    uint32_t currently_aged_tasks() const {
+        uint32_t aged = 0;
+        for (auto &generation: this->aged_generations)
+            aged += generation->tasks->size();
+
+        return aged;
+    }
+
+    // level 1 is the first one above the young generation
+    uint32_t currently_aged_tasks(uint32_t level) const {
+        return this->aged_generations[level - 1]->tasks->size();
+    }
+
+    // young generation included
+    uint32_t get_levels_num() const {
+        return this->aged_generations.size() + 1;
+    }
+
+    YoungQueueMode get_queue_mode() const {
+        return this->queue_mode;
+    }
+
+    // admitted tasks no worker has taken yet, what AdmissionControl::capacity limits
+    uint32_t currently_admitted_tasks() const {
+        return this->admitted_tasks.load(std::memory_order_relaxed);
+    }
+
+    // queued and running tasks, what wait_idle waits to drop to zero
+    uint32_t currently_outstanding_tasks() const {
+        return this->outstanding_tasks.load(std::memory_order_relaxed);
+    }
+
+    const AdmissionControl &get_admission() const {
+        return this->admission;
+    }
+
+    uint32_t get_young_workers() const {
+        return this->active_young_workers.load(std::memory_order_relaxed);
+    }
+
+    // ids handed to tasks built outside the pool, shared with submit
+    uint32_t reserve_task_id() {
+        return this->next_task_id++;
+    }
+
+    // only WeightedFairQueuing looks at it
+    void set_tenant_weight(uint32_t tenant, double weight) {
+        this->fair_share.set_weight(tenant, weight);
     }
 
 public:
-    void add_task(const ThreadTask &task);
+    // an empty ticket when the task was not queued: a task the pool refused is not moved from,
+    // one the caller_runs policy ran on this thread is. A FirstInFirstOut pool also refuses a task
+    // once every young ring is full, under any overflow policy, see AdmissionControl::ring_capacity.
+    TaskTicket add_task(ThreadTask &&task);
+
+    // add_task that refuses instead of applying the overflow policy
+    TaskTicket try_add_task(ThreadTask &&task);
+
+    // drops the task if it is still queued, false once a worker has taken it
+    // or when the queue cannot erase, as MpmcRing
+    bool cancel(const TaskTicket &ticket);
+
+    // moves the tasks out of the range, returns how many were taken, queued or run by the caller.
+    // Tasks the pool refused are left in the range, for a FirstInFirstOut pool also those that did not fit into a ring.
+    template <typename Iterator>
+    size_t add_tasks(Iterator first, Iterator last);
+
+    size_t add_tasks(std::vector<ThreadTask> &&tasks) {
+        return this->add_tasks(tasks.begin(), tasks.end());
+    }
+
+    // wait_time is the task's priority, the shorter the sooner it runs
+    template <typename FT>
+    auto submit(FT &&func, std::chrono::milliseconds wait_time = std::chrono::milliseconds(0))
+    -> TaskFuture<std::invoke_result_t<std::decay_t<FT> &>>;
+
+#ifdef LAB2_COROUTINES
+    // co_await pool.schedule() moves the rest of the coroutine onto a worker
+    ScheduleAwaitable<BasicThreadPool> schedule(std::chrono::milliseconds wait_time = std::chrono::milliseconds(0));
+
+    // starts the coroutine on a worker, the future completes when it does
+    template <typename R>
+    TaskFuture<R> spawn(PoolTask<R> &&task);
+#endif
 
     void start();
 
@@ -42,6 +258,13 @@ public:
 
     void resume();
 
+    // waits until no task is queued or running, tasks added meanwhile included, so on a paused pool
+    // until it is resumed. False on timeout, once the pool terminated or when called from one of its workers
+    bool wait_idle(std::chrono::milliseconds timeout);
+
+    bool drain();
+
+    // finish_tasks_in_queue resumes and drains the pool first, with admission closed to all but its own workers
     void terminate(bool finish_tasks_in_queue = false);
 
     Telemetry& get_telemetry() {
@@ -49,37 +272,101 @@ public:
     }
 
 public:
-    ThreadPool(ThreadPool const &other) = delete;
+    BasicThreadPool(BasicThreadPool const &other) = delete;
 
-    ThreadPool &operator=(ThreadPool const &rhs) = delete;
+    BasicThreadPool &operator=(BasicThreadPool const &rhs) = delete;
 
 private:
     bool initialized = false;
-    bool terminated = false;
+    std::atomic<bool> terminated{false};
     bool stopped = false;
 
-    bool is_last_wish = false;
+    std::atomic<bool> draining{false};
 
+    // upper bound, workers with an id at or above active_young_workers retire
     uint32_t young_threads_num;
+    std::atomic<uint32_t> active_young_workers{0};
+    ElasticScaling scaling;
+
+    YoungQueueMode queue_mode;
+
+    AdmissionControl admission;
+    std::atomic<uint32_t> admitted_tasks{0};
+    std::atomic<uint32_t> blocked_producers{0};
+
+    std::atomic<uint32_t> outstanding_tasks{0};
+    std::atomic<uint32_t> idle_waiters{0};
+
+    // set on the threads of a pool, so that they never block on their own pool
+    static inline thread_local const BasicThreadPool *worker_of = nullptr;
+
+    std::atomic<uint32_t> next_young_queue{0};
+    std::atomic<uint32_t> next_task_id{0};
+
+    IdleWorkers young_idle_workers{};
 
-    static bool comparator(const std::shared_ptr<ThreadTask> &a, const std::shared_ptr<ThreadTask> &b) {
-        return a->wait_time > b->wait_time;
+    FairShareClock fair_share{};
+
+    std::unique_ptr<Queue> make_queue() const {
+        if constexpr (Queue::bounded) {
+            return std::make_unique<Queue>(this->admission.ring_capacity);
+        } else {
+            return std::make_unique<Queue>();
+        }
+    }
+
+    // declared before the queues so that it outlives every task node
+    SlabAllocator<ThreadTask> task_allocator{};
+
+    struct AgedGeneration {
+        AgedGeneration(const AgingLevel &level, std::unique_ptr<Queue> tasks)
+                : level(level), tasks(std::move(tasks)) {}
+
+        AgingLevel level;
+        std::unique_ptr<Queue> tasks;
+
+        std::vector<std::thread> workers{};
+        IdleWorkers idle_workers{};
     };
 
-    PoolQueue young_generation_tasks{ThreadPool::comparator};
-    PoolQueue old_generation_tasks{ThreadPool::comparator};
+    std::vector<std::unique_ptr<Queue>> young_generation_tasks;
+    // level i + 1 of the feedback queue
+    std::vector<std::unique_ptr<AgedGeneration>> aged_generations;
+
+    // indexed by thread id
+    std::unique_ptr<Parker[]> parkers;
+
+    // indexed by thread id, empty when workers are not pinned
+    std::vector<int> worker_cpus;
+    // heaps a young worker steals from, the ones of its own NUMA node first
+    std::vector<std::vector<uint32_t>> steal_victims;
 
 private:
     std::unique_ptr<std::thread[]> young_workers;
-    std::thread old_worker;
+    // guarded by common_lock, false once a retired worker has left its routine
+    std::unique_ptr<bool[]> young_workers_running;
+
+    std::thread scaler;
+    std::condition_variable_any scaler_waiter{};
+
+    // promotes tasks when they are due even while every worker is busy or asleep
+    std::thread promoter;
+    std::condition_variable_any promoter_waiter{};
+    // guarded by promotion_lock, the promoter is woken up for a timer due before it
+    Clock::time_point promoter_wakeup{Clock::time_point::max()};
 
     mutable rw_lock common_lock;
     mutable rw_lock pause_lock;
+    mutable rw_lock promotion_lock;
+    mutable rw_lock admission_lock;
+    mutable rw_lock idle_lock;
+
+    // fires once a task has waited long enough for the next level
+    TimerWheel<PromotionTimer> promotion_timers{};
 
-    std::condition_variable_any young_task_waiter{};
-    std::condition_variable_any old_task_waiter{};
     std::condition_variable_any pause_waiter{};
-    std::condition_variable_any last_wish_waiter{};
+    std::condition_variable_any idle_waiter{};
+    std::condition_variable_any admission_waiter{};
 
     Telemetry telemetry{};
 
@@ -87,24 +374,120 @@ private:
 
     void initialize(bool start_immediately);
 
-    void thread_routine(uint32_t thread_id, bool is_young);
+    void place_workers(const WorkerAffinity &affinity, size_t workers_num);
+
+    // level 0 is the young generation
+    void thread_routine(uint32_t thread_id, uint32_t level);
+
+    void scaling_routine();
 
-    void review_young_generation();
+    void promotion_routine();
 
-    bool get_task_from_queue(PoolQueue *queue, std::shared_ptr<ThreadTask> &out_task, bool is_young);
+    void scale_young_workers(int32_t change);
 
-    PoolQueue *current_queue(bool is_young) {
-        if (is_young)
-            return &this->young_generation_tasks;
+    bool retire_young_worker(uint32_t thread_id);
 
-        return &this->old_generation_tasks;
+    bool young_worker_retired(uint32_t thread_id) const {
+        return thread_id >= this->active_young_workers.load(std::memory_order_acquire);
     }
 
-    std::condition_variable_any *current_monitor(bool is_young) {
-        if (is_young)
-            return &this->young_task_waiter;
+    void review_promotions();
+
+    void drop_queued_tasks();
+
+    // removes the task from the heap holding it, false when it was taken or recycled already
+    static bool take_queued_task(const TaskTicket &ticket, TaskHandle &out_task);
+
+    // the caller holds promotion_lock
+    void schedule_promotion(const TaskHandle &task, uint32_t level);
+
+    bool get_task_from_queue(uint32_t thread_id, TaskHandle &out_task, uint32_t level);
 
-        return &this->old_task_waiter;
+    bool try_obtain_task(uint32_t thread_id, TaskHandle &out_task, uint32_t level);
+
+    bool steal_task(uint32_t thread_id, TaskHandle &out_task, bool is_young);
+
+    bool help_aged_generations(uint32_t own_level, TaskHandle &out_task);
+
+    // the tasks it queued are taken out of the batch, the refused ones are left in it
+    size_t add_tasks_batch(std::vector<TaskHandle> &batch);
+
+    TaskTicket admit_task(ThreadTask &&task, OverflowPolicy overflow, bool &taken);
+
+    // takes up to wanted slots of the capacity, returns how many it got
+    uint32_t reserve_slots(uint32_t wanted);
+
+    // slots of tasks that left the queues, wakes producers blocked on them
+    void release_slots(uint32_t released);
+
+    // false when the pool terminated first
+    bool wait_for_slot();
+
+    // while draining, only tasks the pool's own workers add are still taken
+    bool accepts_tasks() const {
+        return this->alive() && (!this->draining || worker_of == this);
+    }
+
+    // wakes wait_idle once the last outstanding task is gone
+    void finish_tasks(uint32_t finished);
+
+    template <typename Wait>
+    bool wait_until_idle(Wait &&wait);
+
+    // the slot of the evicted task goes to the new one
+    bool evict_lower_than(const ThreadTask &task);
+
+    void run_on_caller(ThreadTask &&task);
+
+    // a task is stamped when it is offered, so a tenant is charged for tasks the pool refuses too
+    void stamp(ThreadTask &task) {
+        if constexpr (Policy::virtual_time)
+            task.virtual_finish = this->fair_share.stamp(task.tenant);
+    }
+
+    // wakes idle workers of the level first, the rest of the tasks go to idle workers of other levels
+    void wake_workers(uint32_t level, size_t tasks_num);
+
+    void wake_all_workers(uint32_t level);
+
+    static TaskTicket ticket_of(const TaskHandle &task) {
+        return TaskTicket{task.get(), task->intrusive_hook.generation.load(std::memory_order_relaxed)};
+    }
+
+    // timers are only kept for queues a task can be taken out of again
+    bool promotes() const {
+        return Queue::erasable && !this->aged_generations.empty();
+    }
+
+    // a bounded queue that is full passes the task on to the next one, false once all were tried
+    bool push_young_task(const TaskHandle &task) {
+        if constexpr (Queue::bounded) {
+            for (uint32_t i = 0; i < this->active_young_workers.load(std::memory_order_relaxed); i++)
+                if (this->local_queue(this->next_active_queue())->push(task))
+                    return true;
+
+            return false;
+        } else {
+            this->local_queue(this->next_active_queue())->push(task);
+            return true;
+        }
+    }
+
+    // round-robin over the heaps of active workers only
+    uint32_t next_active_queue() {
+        return this->next_young_queue.fetch_add(1, std::memory_order_relaxed)
+               % this->active_young_workers.load(std::memory_order_relaxed);
+    }
+
+    Queue *local_queue(uint32_t thread_id) {
+        return this->young_generation_tasks[thread_id % this->young_generation_tasks.size()].get();
+    }
+
+    IdleWorkers &idle_workers(uint32_t level) {
+        if (level == 0)
+            return this->young_idle_workers;
+
+        return this->aged_generations[level - 1]->idle_workers;
     }
 
     void check_pause() {
@@ -113,4 +496,80 @@ private:
     }
 };
 
+template <typename Policy>
+template <typename Iterator>
+size_t BasicThreadPool<Policy>::add_tasks(Iterator first, Iterator last) {
+    // what fits into the capacity goes in as one batch, the rest one by one through the overflow policy
+    uint32_t slots = this->accepts_tasks() ? this->reserve_slots((uint32_t) std::distance(first, last)) : 0;
+
+    std::vector<TaskHandle> batch;
+    batch.reserve(slots);
+
+    auto batch_first = first;
+
+    uint64_t reused_nodes = 0;
+    for (uint32_t i = 0; i < slots; i++, ++first) {
+        this->stamp(*first);
+
+        bool reused;
+        batch.push_back(this->task_allocator.make(std::move(*first), reused));
+        reused_nodes += reused;
+    }
+
+    this->telemetry.tasks_allocated(batch.size(), reused_nodes);
+
+    size_t taken = this->add_tasks_batch(batch);
+    if (taken < slots)
+        this->release_slots(slots - taken);
+
+    // handed back to where they came from, as admit_task leaves a task it refused untouched
+    for (auto &task: batch) {
+        if (task)
+            *batch_first = std::move(*task);
+
+        ++batch_first;
+    }
+
+    for (; first != last; ++first) {
+        bool task_taken;
+        this->admit_task(std::move(*first), this->admission.overflow, task_taken);
+        taken += task_taken;
+    }
+
+    return taken;
+}
+
+template <typename Policy>
+template <typename FT>
+auto BasicThreadPool<Policy>::submit(FT &&func, std::chrono::milliseconds wait_time)
+-> TaskFuture<std::invoke_result_t<std::decay_t<FT> &>> {
+    using result_type = std::invoke_result_t<std::decay_t<FT> &>;
+
+    auto state = std::make_shared<TaskState<result_type>>();
+    TaskFuture<result_type> future{state};
+
+    ThreadTask task{
+            [promise = TaskPromise<result_type>(std::move(state)), func = std::forward<FT>(func)]() mutable {
+                promise.run(func);
+            },
+            this->next_task_id++,
+            Clock::now(),
+            wait_time,
+    };
+
+    // a rejected task is destroyed here, its promise fails the future
+    this->add_task(std::move(task));
+
+    return future;
+}
+
+typedef BasicThreadPool<ShortestJobFirst> ThreadPool;
+typedef BasicThreadPool<FirstInFirstOut> FifoThreadPool;
+typedef BasicThreadPool<EarliestDeadlineFirst> EdfThreadPool;
+typedef BasicThreadPool<WeightedFairQueuing> FairThreadPool;
+
+#ifdef LAB2_COROUTINES
+#include "pool_coroutine.h"
+#endif
+
 #endif //LAB2_THREAD_POOL_H
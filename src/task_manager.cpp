@@ -1,38 +1,65 @@
 #include "task_manager.h"
 
-TaskManager::TaskManager(ThreadPool *pool, bool start_immediately) {
+namespace {
+    // keeps the core busy until the duration has passed on Clock
+    void burn_cpu(std::chrono::milliseconds duration) {
+        auto end = Clock::now() + duration;
+        uint64_t state = 0x9e3779b97f4a7c15ull;
+
+        while (Clock::now() < end) {
+            for (uint32_t i = 0; i < 1024; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+            }
+        }
+
+        // keeps the loop from being optimized away
+        asm volatile("" : : "r"(state));
+    }
+
+    uint64_t to_microseconds(Clock::duration duration) {
+        auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        return microseconds > 0 ? microseconds : 0;
+    }
+}
+
+TaskManager::TaskManager(ThreadPool *pool, bool start_immediately, const LoadProfile &profile) {
     this->thread_pool = pool;
 
-    this->generator = std::default_random_engine(seed());
-    this->worker_sleep_time_distribution = std::uniform_int_distribution<uint32_t>(1000, 3000);
-    this->task_wait_time_distribution = std::uniform_int_distribution<uint32_t>(5000, 10000);
+    this->profile = profile;
+    this->profile.producers = std::max(1u, profile.producers);
+    this->profile.rate = std::max(profile.rate, 1e-6);
+    if (this->profile.costs.empty())
+        this->profile.costs.push_back(TaskCost{});
 
     this->is_alive = true;
     this->is_producing = start_immediately;
 
-    this->workers_num = 2;
+    this->workers_num = this->profile.producers;
     this->workers = std::make_unique<std::thread[]>(this->workers_num);
 
     if (this->is_producing) {
-        for (size_t i = 0; i < this->workers_num; i++)
-            this->workers[i] = std::thread(&TaskManager::worker_routine, this);
+        this->start_workers();
 
-        write_lock _s(stdout_lock);
-        std::cout << terminal.cyan << "Task manager started\n" << terminal.reset;
+        LOG_INFO(terminal.cyan, "Task manager started\n");
     }
 }
 
+void TaskManager::start_workers() {
+    for (size_t i = 0; i < this->workers_num; i++)
+        this->workers[i] = std::thread(&TaskManager::worker_routine, this, i, this->seed());
+}
+
 void TaskManager::start_task_manager() {
     write_lock _(this->read_write_lock);
     if (this->is_producing) return;
 
     this->is_producing = true;
 
-    for (size_t i = 0; i < this->workers_num; i++)
-        this->workers[i] = std::thread(&TaskManager::worker_routine, this);
+    this->start_workers();
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.cyan << "Task manager started\n" << terminal.reset;
+    LOG_INFO(terminal.cyan, "Task manager started\n");
 }
 
 void TaskManager::pool_stop() {
@@ -81,35 +108,84 @@ void TaskManager::terminate(bool finish_tasks_in_queue) {
 
     this->is_producing = false;
 
-    write_lock _(stdout_lock);
-    std::cout << terminal.red << "Task manager terminated\n" << terminal.reset;
+    LOG_INFO(terminal.red, "Task manager terminated\n");
 }
 
-void TaskManager::worker_routine() {
+bool TaskManager::wait_until(Clock::time_point arrival) {
+    write_lock _(this->read_write_lock);
+
+    auto now = Clock::now();
+    if (arrival > now)
+        this->waiter.wait_for(_, Clock::to_real(arrival - now), [this]() { return !this->is_alive; });
+
+    return this->is_alive;
+}
+
+void TaskManager::worker_routine(uint32_t producer, uint32_t seed) {
+    Tracer::name_current_thread("producer " + std::to_string(producer));
+
+    std::default_random_engine generator(seed);
+    std::exponential_distribution<double> poisson_gaps(this->profile.rate);
+
+    std::vector<double> weights;
+    for (auto &cost: this->profile.costs)
+        weights.push_back(cost.weight);
+    std::discrete_distribution<size_t> mix(weights.begin(), weights.end());
+
+    auto on_period = std::chrono::duration_cast<Clock::duration>(this->profile.on_period);
+    auto cycle = on_period + std::chrono::duration_cast<Clock::duration>(this->profile.off_period);
+
+    auto next_gap = [&]() {
+        auto seconds = this->profile.arrivals == ArrivalProcess::constant ? 1 / this->profile.rate
+                                                                           : poisson_gaps(generator);
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    };
+
+    auto origin = Clock::now();
+    auto arrival = origin;
+
     while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(this->random_sleep_time()));
+        arrival += next_gap();
 
-        this->check_pause();
+        if (this->profile.arrivals == ArrivalProcess::on_off && cycle > Clock::duration::zero()) {
+            auto phase = (arrival - origin) % cycle;
+            if (phase >= on_period)
+                arrival += cycle - phase;
+        }
 
-        {
-            write_lock _(this->read_write_lock);
-            this->waiter.wait_for(_, std::chrono::seconds(1), [this]() { return this->is_alive; });
+        if (!this->wait_until(arrival))
+            return;
 
-            if (!this->is_alive) return;
+        // the schedule starts over after a pause rather than catching up on it
+        if (this->check_pause()) {
+            origin = arrival = Clock::now();
+            continue;
         }
 
-        int64_t task_duration = this->random_task_duration();
+        auto &cost = this->profile.costs[mix(generator)];
+        auto duration = std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(
+                cost.min_duration.count(), std::max(cost.min_duration, cost.max_duration).count())(generator));
+
+        auto response_times = this->response_times;
+        auto submitted = Clock::now();
 
         ThreadTask task{
-                [task_duration]() {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(task_duration));
+                [response_times, kind = cost.kind, duration, arrival, submitted]() {
+                    if (kind == TaskCostKind::cpu)
+                        burn_cpu(duration);
+                    else
+                        Clock::sleep_for(duration);
+
+                    auto finished = Clock::now();
+                    response_times->corrected.record(to_microseconds(finished - arrival));
+                    response_times->uncorrected.record(to_microseconds(finished - submitted));
                 },
                 this->task_id++,
-                std::chrono::high_resolution_clock::now(),
-                std::chrono::milliseconds(task_duration),
+                submitted,
+                duration,
         };
 
-        this->thread_pool->add_task(task);
+        this->thread_pool->add_task(std::move(task));
     }
 }
 
@@ -122,8 +198,7 @@ void TaskManager::stop_task_producing() {
     write_lock _(this->pause_lock);
     this->is_producing = false;
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.red << "Stopped task producing in task manager\n" << terminal.reset;
+    LOG_INFO(terminal.red, "Stopped task producing in task manager\n");
 }
 
 void TaskManager::resume_task_producing() {
@@ -132,6 +207,5 @@ void TaskManager::resume_task_producing() {
 
     this->pause_waiter.notify_all();
 
-    write_lock _s(stdout_lock);
-    std::cout << terminal.cyan << "Resumed task producing in task manager\n" << terminal.reset;
+    LOG_INFO(terminal.cyan, "Resumed task producing in task manager\n");
 }
\ No newline at end of file
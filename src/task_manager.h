@@ -7,13 +7,57 @@
 #include <random>
 #include <atomic>
 
+// How the gaps between the tasks of one producer are drawn. The arrivals are an open loop:
+// a producer that falls behind its schedule adds the late tasks right away instead of shifting it.
+enum class ArrivalProcess {
+    constant,
+    poisson,
+    // poisson arrivals during on_period, none during off_period
+    on_off
+};
+
+enum class TaskCostKind {
+    // a task waiting on I/O
+    sleep,
+    // a task keeping a core busy
+    cpu
+};
+
+// One kind of task in the mix, its duration is drawn uniformly and doubles as its wait_time
+struct TaskCost {
+    TaskCostKind kind = TaskCostKind::sleep;
+    std::chrono::milliseconds min_duration{5000};
+    std::chrono::milliseconds max_duration{10000};
+    // share of the mix relative to the other costs
+    double weight = 1;
+};
+
+struct LoadProfile {
+    uint32_t producers = 2;
+    ArrivalProcess arrivals = ArrivalProcess::poisson;
+    // tasks per second of every producer, within the on periods for on_off
+    double rate = 0.5;
+    std::chrono::milliseconds on_period{2000};
+    std::chrono::milliseconds off_period{6000};
+    std::vector<TaskCost> costs{TaskCost{}};
+};
+
 class TaskManager {
 private:
 
     ThreadPool *thread_pool;
 
+    // shared with the tasks, which may outlive the manager in a pool that is not terminated yet
+    struct ResponseTimes {
+        // from the arrival the schedule intended to task completion, so the wait of a producer
+        // held up by a saturated pool is not omitted from the measurement
+        LatencyHistogram corrected{};
+        // from the add_task call to task completion
+        LatencyHistogram uncorrected{};
+    };
+
 public:
-    TaskManager(ThreadPool *pool, bool start_immediately = false);
+    TaskManager(ThreadPool *pool, bool start_immediately = false, const LoadProfile &profile = LoadProfile{});
 
     ~TaskManager() = default;
 
@@ -23,19 +67,21 @@ public:
 
 private:
 
-    void worker_routine();
+    void worker_routine(uint32_t producer, uint32_t seed);
 
-    uint32_t random_sleep_time() {
-        return this->worker_sleep_time_distribution(this->generator);
-    }
+    void start_workers();
 
-    uint32_t random_task_duration() {
-        return this->task_wait_time_distribution(this->generator);
-    }
+    // false once the manager is terminated
+    bool wait_until(Clock::time_point arrival);
 
-    void check_pause() {
+    // true when it had to wait
+    bool check_pause() {
         write_lock _(this->pause_lock);
+        if (this->is_producing)
+            return false;
+
         this->pause_waiter.wait(_, [this]() { return this->is_producing; });
+        return true;
     }
 
 public:
@@ -61,15 +107,31 @@ public:
         return this->thread_pool->get_telemetry();
     };
 
+    const LoadProfile &get_profile() const {
+        return this->profile;
+    }
+
+    // in microseconds, see ResponseTimes
+    HistogramSnapshot get_response_time(bool corrected = true) const {
+        HistogramSnapshot snapshot{};
+        (corrected ? this->response_times->corrected : this->response_times->uncorrected).add_to(snapshot);
+
+        return snapshot;
+    }
+
 private:
     std::atomic<uint32_t> task_id{0};
 
     bool is_alive = false;
     bool is_producing = true;
 
+    LoadProfile profile;
+
     uint32_t workers_num;
     std::unique_ptr<std::thread[]> workers;
 
+    std::shared_ptr<ResponseTimes> response_times = std::make_shared<ResponseTimes>();
+
     rw_lock read_write_lock;
     rw_lock pause_lock;
     std::condition_variable_any waiter;
@@ -77,12 +139,8 @@ private:
 
 private:
 
+    // every producer draws from its own engine seeded from here
     std::random_device seed;
-    std::default_random_engine generator;
-    std::uniform_int_distribution<uint32_t> worker_sleep_time_distribution;
-    std::uniform_int_distribution<uint32_t> task_wait_time_distribution;
-
-    Telemetry telemetry{};
 };
 
 #endif //LAB2_TASK_MANAGER_H
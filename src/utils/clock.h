@@ -0,0 +1,63 @@
+#ifndef LAB2_CLOCK_H
+#define LAB2_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Clock used for every scheduling decision and telemetry measurement.
+// With a time scale above 1 it runs as a simulation: virtual time passes time_scale times faster
+// than wall time, and Clock::sleep_for sleeps the correspondingly shorter wall time,
+// so an hour of workload with a scale of 3600 replays in about a second.
+class Clock {
+public:
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<Clock, duration>;
+
+    static constexpr bool is_steady = true;
+
+    static time_point now() noexcept {
+        auto real_now = std::chrono::steady_clock::now();
+        auto scale = time_scale.load(std::memory_order_acquire);
+
+        if (scale == 1.0 && virtual_origin.time_since_epoch() == real_origin.time_since_epoch())
+            return time_point(real_now.time_since_epoch());
+
+        return virtual_origin + duration((rep) ((double) (real_now - real_origin).count() * scale));
+    }
+
+    // not synchronized with concurrent now() calls, set it before pools and task managers start
+    static void set_time_scale(double scale) {
+        virtual_origin = now();
+        real_origin = std::chrono::steady_clock::now();
+        time_scale.store(scale, std::memory_order_release);
+    }
+
+    static double get_time_scale() {
+        return time_scale.load(std::memory_order_acquire);
+    }
+
+    static bool simulated() {
+        return get_time_scale() != 1.0;
+    }
+
+    template <typename Rep, typename Period>
+    static std::chrono::nanoseconds to_real(std::chrono::duration<Rep, Period> virtual_duration) {
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(virtual_duration);
+        return std::chrono::nanoseconds((rep) ((double) nanoseconds.count() / get_time_scale()));
+    }
+
+    template <typename Rep, typename Period>
+    static void sleep_for(std::chrono::duration<Rep, Period> virtual_duration) {
+        std::this_thread::sleep_for(to_real(virtual_duration));
+    }
+
+private:
+    inline static std::atomic<double> time_scale{1.0};
+    inline static std::chrono::steady_clock::time_point real_origin{};
+    inline static time_point virtual_origin{};
+};
+
+#endif //LAB2_CLOCK_H
@@ -5,6 +5,83 @@
 #include <vector>
 #include <memory>
 
+// Reference counted pointer that keeps its counter in the object's IntrusiveRefCount
+// named intrusive_hook, so handing a task between queues costs no extra allocation.
+template <typename T>
+class IntrusivePtr {
+public:
+    IntrusivePtr() = default;
+
+    explicit IntrusivePtr(T *pointer) : pointer(pointer) {
+        this->acquire();
+    }
+
+    IntrusivePtr(const IntrusivePtr &other) : pointer(other.pointer) {
+        this->acquire();
+    }
+
+    IntrusivePtr(IntrusivePtr &&other) noexcept : pointer(other.pointer) {
+        other.pointer = nullptr;
+    }
+
+    IntrusivePtr &operator=(const IntrusivePtr &rhs) {
+        IntrusivePtr(rhs).swap(*this);
+        return *this;
+    }
+
+    IntrusivePtr &operator=(IntrusivePtr &&rhs) noexcept {
+        IntrusivePtr(std::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    inline ~IntrusivePtr() { release(); }
+
+    T *get() const { return this->pointer; }
+
+    T &operator*() const { return *this->pointer; }
+
+    T *operator->() const { return this->pointer; }
+
+    explicit operator bool() const { return this->pointer != nullptr; }
+
+    bool operator==(const IntrusivePtr &rhs) const { return this->pointer == rhs.pointer; }
+
+    bool operator!=(const IntrusivePtr &rhs) const { return this->pointer != rhs.pointer; }
+
+    void reset() {
+        this->release();
+        this->pointer = nullptr;
+    }
+
+    void swap(IntrusivePtr &other) noexcept {
+        std::swap(this->pointer, other.pointer);
+    }
+
+private:
+    T *pointer = nullptr;
+
+    void acquire() {
+        if (this->pointer)
+            this->pointer->intrusive_hook.references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() {
+        if (!this->pointer || this->pointer->intrusive_hook.references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        auto &hook = this->pointer->intrusive_hook;
+        if (hook.recycle)
+            hook.recycle(this->pointer, hook.recycle_context);
+        else
+            delete this->pointer;
+    }
+};
+
+template <typename T, typename... Args>
+IntrusivePtr<T> make_intrusive(Args &&... args) {
+    return IntrusivePtr<T>(new T{std::forward<Args>(args)...});
+}
+
 template <typename T>
 class PriorityQueue {
     using queue_implementation = std::vector<std::shared_ptr<T>>;
@@ -111,4 +188,273 @@ std::shared_ptr<T> &PriorityQueue<T>::at(uint32_t index) {
     return this->queue_base[index];
 }
 
+// Binary heap that keeps every element's position in its IndexedHeapHook,
+// so an element can be erased or re-prioritized through its handle in O(log n).
+// T must expose an IndexedHeapHook named heap_hook. Compare(a, b) is true when a is popped after b,
+// a function object type gets inlined into the sifts where a function pointer is called through.
+template <typename T, typename Compare = bool (*)(const IntrusivePtr<T> &, const IntrusivePtr<T> &)>
+class IndexedPriorityQueue {
+    using handle_type = IntrusivePtr<T>;
+    using queue_implementation = std::vector<handle_type>;
+
+public:
+    // see BasicThreadPool
+    static constexpr bool bounded = false;
+    static constexpr bool erasable = true;
+
+    explicit IndexedPriorityQueue(Compare comparator = Compare{}) {
+        this->comparator = comparator;
+    };
+
+    inline ~IndexedPriorityQueue() { clear(); }
+
+    bool empty() const;
+
+    size_t size() const;
+
+    bool contains(const handle_type &value) const;
+
+public:
+    void clear();
+
+    bool pop(handle_type &out_value);
+
+    void push(const handle_type &value);
+
+    // one lock and a single heapify for the whole batch
+    template <typename Iterator>
+    void push_bulk(Iterator first, Iterator last);
+
+    bool erase(const handle_type &value);
+
+    // erases the element behind a raw pointer if it is still here and satisfies the predicate
+    template <typename FT>
+    bool erase_if(const T *value, FT predicate, handle_type &out_value);
+
+    bool update(const handle_type &value);
+
+    // erases the element that would be popped last if it satisfies the predicate, O(n) as it is one of the leaves
+    template <typename FT>
+    bool erase_lowest_if(FT predicate, handle_type &out_value);
+
+public:
+    IndexedPriorityQueue(IndexedPriorityQueue const &other) = delete;
+
+    IndexedPriorityQueue &operator=(IndexedPriorityQueue const &rhs) = delete;
+
+private:
+    mutable rw_lock read_write_lock;
+
+    queue_implementation queue_base;
+
+    Compare comparator;
+
+private:
+    bool owns(const T *value) const {
+        return value && value->heap_hook.owner.load(std::memory_order_acquire) == this;
+    }
+
+    void place(size_t position, handle_type &&value) {
+        value->heap_hook.position = position;
+        this->queue_base[position] = std::move(value);
+    }
+
+    void sift_up(size_t position);
+
+    void sift_down(size_t position);
+
+    void remove_at(size_t position, handle_type &out_value);
+};
+
+template <typename T, typename Compare>
+bool IndexedPriorityQueue<T, Compare>::empty() const {
+    read_lock _(this->read_write_lock);
+    return this->queue_base.empty();
+}
+
+template <typename T, typename Compare>
+size_t IndexedPriorityQueue<T, Compare>::size() const {
+    read_lock _(this->read_write_lock);
+    return this->queue_base.size();
+}
+
+template <typename T, typename Compare>
+bool IndexedPriorityQueue<T, Compare>::contains(const handle_type &value) const {
+    read_lock _(this->read_write_lock);
+    return this->owns(value.get());
+}
+
+template <typename T, typename Compare>
+void IndexedPriorityQueue<T, Compare>::clear() {
+    write_lock _(this->read_write_lock);
+    while (!this->queue_base.empty()) {
+        this->queue_base.back()->heap_hook.owner.store(nullptr, std::memory_order_release);
+        this->queue_base.pop_back();
+    }
+}
+
+template <typename T, typename Compare>
+bool IndexedPriorityQueue<T, Compare>::pop(handle_type &out_value) {
+    write_lock _(this->read_write_lock);
+
+    if (this->queue_base.empty()) return false;
+
+    this->remove_at(0, out_value);
+
+    return true;
+}
+
+template <typename T, typename Compare>
+void IndexedPriorityQueue<T, Compare>::push(const handle_type &value) {
+    write_lock _(this->read_write_lock);
+
+    value->heap_hook.owner.store(this, std::memory_order_release);
+
+    this->queue_base.emplace_back();
+    this->place(this->queue_base.size() - 1, handle_type(value));
+    this->sift_up(this->queue_base.size() - 1);
+}
+
+template <typename T, typename Compare>
+template <typename Iterator>
+void IndexedPriorityQueue<T, Compare>::push_bulk(Iterator first, Iterator last) {
+    write_lock _(this->read_write_lock);
+
+    auto old_size = this->queue_base.size();
+
+    for (; first != last; ++first) {
+        (*first)->heap_hook.owner.store(this, std::memory_order_release);
+
+        this->queue_base.emplace_back();
+        this->place(this->queue_base.size() - 1, handle_type(*first));
+    }
+
+    auto new_size = this->queue_base.size();
+    auto added = new_size - old_size;
+
+    // rebuilding is O(n), sifting every new element up is O(k log n)
+    if (added > new_size / 8) {
+        for (size_t i = new_size / 2; i-- > 0;)
+            this->sift_down(i);
+    } else {
+        for (size_t i = old_size; i < new_size; i++)
+            this->sift_up(i);
+    }
+}
+
+template <typename T, typename Compare>
+bool IndexedPriorityQueue<T, Compare>::erase(const handle_type &value) {
+    write_lock _(this->read_write_lock);
+
+    if (!this->owns(value.get())) return false;
+
+    handle_type erased;
+    this->remove_at(value->heap_hook.position, erased);
+
+    return true;
+}
+
+template <typename T, typename Compare>
+template <typename FT>
+bool IndexedPriorityQueue<T, Compare>::erase_if(const T *value, FT predicate, handle_type &out_value) {
+    write_lock _(this->read_write_lock);
+
+    if (!this->owns(value) || !predicate(*value)) return false;
+
+    this->remove_at(value->heap_hook.position, out_value);
+
+    return true;
+}
+
+template <typename T, typename Compare>
+bool IndexedPriorityQueue<T, Compare>::update(const handle_type &value) {
+    write_lock _(this->read_write_lock);
+
+    if (!this->owns(value.get())) return false;
+
+    auto position = value->heap_hook.position;
+    this->sift_up(position);
+    if (value->heap_hook.position == position)
+        this->sift_down(position);
+
+    return true;
+}
+
+template <typename T, typename Compare>
+template <typename FT>
+bool IndexedPriorityQueue<T, Compare>::erase_lowest_if(FT predicate, handle_type &out_value) {
+    write_lock _(this->read_write_lock);
+
+    if (this->queue_base.empty()) return false;
+
+    auto lowest = this->queue_base.size() / 2;
+    for (auto i = lowest + 1; i < this->queue_base.size(); i++)
+        if (this->comparator(this->queue_base[i], this->queue_base[lowest]))
+            lowest = i;
+
+    if (!predicate(*this->queue_base[lowest])) return false;
+
+    this->remove_at(lowest, out_value);
+
+    return true;
+}
+
+template <typename T, typename Compare>
+void IndexedPriorityQueue<T, Compare>::sift_up(size_t position) {
+    auto value = std::move(this->queue_base[position]);
+
+    while (position > 0) {
+        auto parent = (position - 1) / 2;
+        if (!this->comparator(this->queue_base[parent], value))
+            break;
+
+        this->place(position, std::move(this->queue_base[parent]));
+        position = parent;
+    }
+
+    this->place(position, std::move(value));
+}
+
+template <typename T, typename Compare>
+void IndexedPriorityQueue<T, Compare>::sift_down(size_t position) {
+    auto size = this->queue_base.size();
+    auto value = std::move(this->queue_base[position]);
+
+    while (true) {
+        auto child = position * 2 + 1;
+        if (child >= size)
+            break;
+
+        if (child + 1 < size && this->comparator(this->queue_base[child], this->queue_base[child + 1]))
+            child++;
+
+        if (!this->comparator(value, this->queue_base[child]))
+            break;
+
+        this->place(position, std::move(this->queue_base[child]));
+        position = child;
+    }
+
+    this->place(position, std::move(value));
+}
+
+template <typename T, typename Compare>
+void IndexedPriorityQueue<T, Compare>::remove_at(size_t position, handle_type &out_value) {
+    out_value = std::move(this->queue_base[position]);
+    out_value->heap_hook.owner.store(nullptr, std::memory_order_release);
+
+    auto last = this->queue_base.size() - 1;
+    if (position != last) {
+        this->place(position, std::move(this->queue_base[last]));
+        this->queue_base.pop_back();
+
+        auto moved = this->queue_base[position].get();
+        this->sift_up(position);
+        if (moved->heap_hook.position == position)
+            this->sift_down(position);
+    } else {
+        this->queue_base.pop_back();
+    }
+}
+
 #endif //LAB2_CONCURRENT_QUEUE_H
@@ -0,0 +1,157 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace {
+    std::vector<uint32_t> allowed_cpus() {
+        std::vector<uint32_t> cpus;
+
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &set))
+                    cpus.push_back(cpu);
+        }
+#endif
+
+        if (cpus.empty())
+            for (uint32_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+                cpus.push_back(cpu);
+
+        return cpus;
+    }
+}
+
+std::vector<uint32_t> CpuTopology::parse_cpu_list(const std::string &list) {
+    std::vector<uint32_t> cpus;
+    size_t position = 0;
+
+    while (position < list.size()) {
+        auto end = list.find(',', position);
+        if (end == std::string::npos)
+            end = list.size();
+
+        auto range = list.substr(position, end - position);
+        position = end + 1;
+
+        auto dash = range.find('-');
+
+        try {
+            uint32_t first = std::stoul(range.substr(0, dash));
+            uint32_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+
+            for (auto cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        } catch (const std::exception &) {
+            // blank or malformed piece, e.g. the trailing newline
+        }
+    }
+
+    return cpus;
+}
+
+CpuTopology CpuTopology::discover() {
+    CpuTopology topology{};
+    auto allowed = allowed_cpus();
+
+    for (uint32_t node = 0;; node++) {
+        std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!cpulist)
+            break;
+
+        std::string list;
+        std::getline(cpulist, list);
+
+        std::vector<uint32_t> cpus;
+        for (auto cpu: parse_cpu_list(list))
+            if (std::binary_search(allowed.begin(), allowed.end(), cpu))
+                cpus.push_back(cpu);
+
+        // node directories can have gaps and memory-only nodes have no CPUs
+        if (!cpus.empty())
+            topology.nodes.push_back(std::move(cpus));
+    }
+
+    if (topology.nodes.empty())
+        topology.nodes.push_back(std::move(allowed));
+
+    return topology;
+}
+
+size_t CpuTopology::cpus_num() const {
+    size_t cpus = 0;
+    for (auto &node: this->nodes)
+        cpus += node.size();
+
+    return cpus;
+}
+
+int CpuTopology::node_of(uint32_t cpu) const {
+    for (size_t node = 0; node < this->nodes.size(); node++)
+        if (std::find(this->nodes[node].begin(), this->nodes[node].end(), cpu) != this->nodes[node].end())
+            return node;
+
+    return -1;
+}
+
+std::vector<int> CpuTopology::place(const WorkerAffinity &affinity, size_t workers_num) const {
+    std::vector<int> placement(workers_num, -1);
+
+    switch (affinity.policy) {
+        case AffinityPolicy::none:
+            break;
+        case AffinityPolicy::compact: {
+            std::vector<uint32_t> cpus;
+            for (auto &node: this->nodes)
+                cpus.insert(cpus.end(), node.begin(), node.end());
+
+            for (size_t i = 0; i < workers_num; i++)
+                placement[i] = cpus[i % cpus.size()];
+            break;
+        }
+        case AffinityPolicy::scatter: {
+            // worker i goes to node i % nodes_num, and within it to the next free CPU
+            std::vector<size_t> used(this->nodes.size(), 0);
+
+            for (size_t i = 0; i < workers_num; i++) {
+                auto node = i % this->nodes.size();
+                placement[i] = this->nodes[node][used[node]++ % this->nodes[node].size()];
+            }
+            break;
+        }
+        case AffinityPolicy::explicit_list: {
+            if (affinity.cpus.empty())
+                break;
+
+            for (size_t i = 0; i < workers_num; i++)
+                placement[i] = affinity.cpus[i % affinity.cpus.size()];
+            break;
+        }
+    }
+
+    return placement;
+}
+
+bool CpuTopology::pin_current_thread(uint32_t cpu) {
+#ifdef __linux__
+    if (cpu >= CPU_SETSIZE)
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef LAB2_CPU_TOPOLOGY_H
+#define LAB2_CPU_TOPOLOGY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// none leaves placement to the scheduler, compact fills one NUMA node before the next,
+// scatter deals workers out across the nodes, explicit_list takes CPUs from WorkerAffinity::cpus
+enum class AffinityPolicy {
+    none,
+    compact,
+    scatter,
+    explicit_list
+};
+
+struct WorkerAffinity {
+    AffinityPolicy policy = AffinityPolicy::none;
+    // used by explicit_list, worker i gets cpus[i % cpus.size()]
+    std::vector<uint32_t> cpus{};
+};
+
+// CPUs the process may run on, grouped by NUMA node as sysfs reports them.
+// Without NUMA information everything lands in node 0.
+class CpuTopology {
+public:
+    static CpuTopology discover();
+
+    [[nodiscard]] size_t nodes_num() const {
+        return this->nodes.size();
+    }
+
+    [[nodiscard]] size_t cpus_num() const;
+
+    // -1 for a CPU that is not known
+    [[nodiscard]] int node_of(uint32_t cpu) const;
+
+    // the CPU for every worker, -1 where the policy does not pin
+    [[nodiscard]] std::vector<int> place(const WorkerAffinity &affinity, size_t workers_num) const;
+
+    // "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist
+    static std::vector<uint32_t> parse_cpu_list(const std::string &list);
+
+    // pins the calling thread, false when the platform or the CPU does not allow it
+    static bool pin_current_thread(uint32_t cpu);
+
+private:
+    std::vector<std::vector<uint32_t>> nodes;
+};
+
+#endif //LAB2_CPU_TOPOLOGY_H
@@ -8,15 +8,20 @@
 #include <iostream>
 #include <cstdint>
 #include <chrono>
+#include <atomic>
 
 #include <thread>
 
+#include "clock.h"
+#include "telemetry.h"
+#include "task_function.h"
+
 using rw_lock = std::shared_mutex;
 using read_lock = std::shared_lock<rw_lock>;
 using write_lock = std::unique_lock<rw_lock>;
 
-static rw_lock stdout_lock;
-static rw_lock telemetry_lock;
+// one lock for the whole program, the Logger drain and the menu print under it
+inline rw_lock stdout_lock;
 
 struct Terminal {
     const char *const red = "\033[0;31m";
@@ -48,111 +53,65 @@ struct MenuOption {
 static constexpr MenuOption menu{};
 static constexpr Terminal terminal{};
 
-struct ThreadTask {
-    std::function<void()> executable;
-    uint32_t id{};
-    std::chrono::high_resolution_clock::time_point creation_point;
-    std::chrono::milliseconds wait_time{};
-    bool is_moved = false;
-    bool is_in_progress = false;
+struct IndexedHeapHook {
+    std::atomic<void *> owner{nullptr};
+    size_t position = 0;
 
-    void operator()() const {
-        executable();
-    }
+    IndexedHeapHook() = default;
 
-    friend bool operator<(const ThreadTask &a, const ThreadTask &b) {
-        return a.wait_time < b.wait_time;
-    }
+    // a copy is a new element, it does not inherit a place in any heap
+    IndexedHeapHook(const IndexedHeapHook &) {}
 
-    ThreadTask() = default;
+    IndexedHeapHook &operator=(const IndexedHeapHook &) { return *this; }
 };
 
-class Telemetry {
-private:
-
-    uint64_t total_sleep_time = 0;
-    uint64_t total_execution_time = 0;
+struct IntrusiveRefCount {
+    std::atomic<uint32_t> references{0};
+    // bumped every time a recycled object is handed out again
+    std::atomic<uint32_t> generation{0};
 
-    uint32_t main_queue_size = 0;
-    uint32_t main_queue_size_measurements = 0;
+    // called instead of delete once the last reference is gone
+    void (*recycle)(void *object, void *context) = nullptr;
+    void *recycle_context = nullptr;
 
-    uint32_t secondary_queue_size = 0;
-    uint32_t secondary_queue_size_measurements = 0;
+    IntrusiveRefCount() = default;
 
-    uint32_t tasks_completed = 0;
-    uint32_t tasks_scheduled = 0;
+    // references belong to the object's storage, not to its value
+    IntrusiveRefCount(const IntrusiveRefCount &) {}
 
-public:
-
-    void add_task() {
-        write_lock _(telemetry_lock);
-        this->tasks_scheduled++;
-    }
-
-    void task_completed(uint64_t execution_time_ms) {
-        write_lock _(telemetry_lock);
-        this->tasks_completed++;
-        this->total_execution_time += execution_time_ms;
-    }
-
-    void update_wait_time(std::chrono::milliseconds millis_waited) {
-        write_lock _(telemetry_lock);
-        this->total_sleep_time += millis_waited.count();
-    }
-
-    void update_main_queue_size(uint32_t current_queue_size) {
-        write_lock _(telemetry_lock);
-
-        this->main_queue_size_measurements++;
-        this->main_queue_size += current_queue_size;
-    }
-
-    void update_secondary_queue_size(uint32_t current_queue_size) {
-        write_lock _(telemetry_lock);
-
-        this->secondary_queue_size_measurements++;
-        this->secondary_queue_size += current_queue_size;
-    }
-
-    [[nodiscard]] uint64_t get_total_sleep_time() const {
-        read_lock _(telemetry_lock);
-        return this->total_sleep_time;
-    }
-
-    [[nodiscard]] double get_avg_main_queue_size() const {
-        read_lock _(telemetry_lock);
-        return (double) this->main_queue_size / this->main_queue_size_measurements;
-    }
-
-    [[nodiscard]] double get_avg_secondary_queue_size() const {
-        read_lock _(telemetry_lock);
-        return (double) this->secondary_queue_size / this->secondary_queue_size_measurements;
-    }
-
-    [[nodiscard]] uint32_t get_scheduled_tasks() const {
-        read_lock _(telemetry_lock);
-        return this->tasks_scheduled;
-    }
+    IntrusiveRefCount &operator=(const IntrusiveRefCount &) { return *this; }
+};
 
-    [[nodiscard]] uint32_t get_completed_tasks() const {
-        read_lock _(telemetry_lock);
-        return this->tasks_completed;
+struct ThreadTask {
+    TaskFunction executable;
+    uint32_t id{};
+    Clock::time_point creation_point;
+    std::chrono::milliseconds wait_time{};
+    // a task still queued past it is skipped instead of run
+    Clock::time_point deadline{Clock::time_point::max()};
+    // share of the pool the task is accounted to under WeightedFairQueuing
+    uint32_t tenant = 0;
+    // set by the pool under WeightedFairQueuing
+    uint64_t virtual_finish = 0;
+    IndexedHeapHook heap_hook{};
+    IntrusiveRefCount intrusive_hook{};
+
+    void operator()() {
+        executable();
     }
 
-    [[nodiscard]] double get_avg_task_execution_time() const {
-        read_lock _(telemetry_lock);
-        return (double) this->total_execution_time / this->tasks_completed;
+    friend bool operator<(const ThreadTask &a, const ThreadTask &b) {
+        return a.wait_time < b.wait_time;
     }
 };
 
-template<typename FT>
-std::chrono::duration<int64_t, std::milli>
-measure_execution_time(FT func) {
-    auto start = std::chrono::high_resolution_clock::now();
+template<typename Duration = std::chrono::milliseconds, typename FT>
+Duration measure_execution_time(FT func) {
+    auto start = Clock::now();
     func();
-    auto end = std::chrono::high_resolution_clock::now();
+    auto end = Clock::now();
 
-    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    return std::chrono::duration_cast<Duration>(end - start);
 }
 
 #endif //LAB2_HELPER_H
@@ -0,0 +1,130 @@
+#include "logger.h"
+
+#include <algorithm>
+
+namespace {
+    struct BufferLease {
+        std::atomic<bool> *released = nullptr;
+
+        ~BufferLease() {
+            if (this->released)
+                this->released->store(true, std::memory_order_release);
+        }
+    };
+}
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() {
+    this->drainer = std::thread(&Logger::drain_routine, this);
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard _(this->drainer_lock);
+        this->running = false;
+        this->drainer_waiter.notify_all();
+    }
+
+    this->drainer.join();
+    this->flush();
+}
+
+Logger::ThreadBuffer *Logger::local_buffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    thread_local BufferLease lease;
+
+    if (!buffer) {
+        buffer = this->acquire_buffer();
+        lease.released = &buffer->released;
+    }
+
+    return buffer;
+}
+
+Logger::ThreadBuffer *Logger::acquire_buffer() {
+    write_lock _(this->buffers_lock);
+
+    // rings of exited threads are handed over, whatever they still hold gets drained as usual
+    for (auto &buffer: this->buffers) {
+        if (buffer->released.load(std::memory_order_acquire)) {
+            buffer->released.store(false, std::memory_order_relaxed);
+            return buffer.get();
+        }
+    }
+
+    this->buffers.push_back(std::make_unique<ThreadBuffer>());
+    return this->buffers.back().get();
+}
+
+void Logger::flush() {
+    this->drain();
+}
+
+void Logger::drain_routine() {
+    std::unique_lock _(this->drainer_lock);
+
+    while (this->running) {
+        _.unlock();
+        auto drained = this->drain();
+        _.lock();
+
+        if (drained == 0)
+            this->drainer_waiter.wait_for(_, std::chrono::milliseconds(5), [this]() { return !this->running; });
+    }
+}
+
+size_t Logger::drain() {
+    std::lock_guard _(this->drain_lock);
+
+    {
+        read_lock _b(this->buffers_lock);
+        LogRecord record{};
+
+        for (auto &buffer: this->buffers)
+            while (buffer->ring.pop(record))
+                this->batch.push_back(record);
+    }
+
+    auto dropped = this->dropped_records.load(std::memory_order_relaxed);
+    if (this->batch.empty() && dropped == this->reported_dropped_records)
+        return 0;
+
+    std::stable_sort(this->batch.begin(), this->batch.end(), [](const LogRecord &a, const LogRecord &b) {
+        return a.timestamp < b.timestamp;
+    });
+
+    char line[512];
+    for (auto &record: this->batch) {
+        this->output += record.color;
+
+        auto length = snprintf(line, sizeof(line), record.format, record.args[0], record.args[1], record.args[2]);
+        this->output.append(line, std::min<size_t>(std::max(length, 0), sizeof(line) - 1));
+
+        this->output += terminal.reset;
+    }
+
+    if (dropped != this->reported_dropped_records) {
+        snprintf(line, sizeof(line), "Logger dropped %llu records\n",
+                 static_cast<unsigned long long>(dropped - this->reported_dropped_records));
+        this->output += terminal.red;
+        this->output += line;
+        this->output += terminal.reset;
+
+        this->reported_dropped_records = dropped;
+    }
+
+    {
+        write_lock _s(stdout_lock);
+        std::cout << this->output << std::flush;
+    }
+
+    auto drained = this->batch.size();
+    this->batch.clear();
+    this->output.clear();
+
+    return drained > 0 ? drained : 1;
+}
@@ -0,0 +1,106 @@
+#ifndef LAB2_LOGGER_H
+#define LAB2_LOGGER_H
+
+#include "helper.h"
+#include "spsc_ring.h"
+
+#include <condition_variable>
+#include <vector>
+
+// records below this level are discarded at compile time
+#ifndef LAB2_LOG_LEVEL
+#define LAB2_LOG_LEVEL 0
+#endif
+
+enum class LogLevel : int32_t {
+    debug = 0,
+    info = 1,
+    warning = 2,
+    error = 3
+};
+
+struct LogRecord {
+    std::chrono::steady_clock::time_point timestamp;
+    const char *color;
+    // printf-style, every argument is passed as unsigned long long (%llu / %lld)
+    const char *format;
+    unsigned long long args[3];
+};
+
+// Producers write into their own lock-free ring, a background thread drains all rings
+// and writes one batch to stdout at a time. A full ring drops the record instead of blocking.
+class Logger {
+    static constexpr size_t ring_capacity = 4096;
+
+    struct ThreadBuffer {
+        SpscRing<LogRecord, ring_capacity> ring;
+        std::atomic<bool> released{false};
+    };
+
+public:
+    static Logger &instance();
+
+    template <typename... Args>
+    void log(const char *color, const char *format, Args... args) {
+        static_assert(sizeof...(Args) <= 3, "A log record holds at most 3 arguments");
+
+        LogRecord record{std::chrono::steady_clock::now(), color, format,
+                         {static_cast<unsigned long long>(args)...}};
+
+        if (!this->local_buffer()->ring.push(record))
+            this->dropped_records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void flush();
+
+    [[nodiscard]] uint64_t get_dropped_records() const {
+        return this->dropped_records.load(std::memory_order_relaxed);
+    }
+
+    ~Logger();
+
+public:
+    Logger(Logger const &other) = delete;
+
+    Logger &operator=(Logger const &rhs) = delete;
+
+private:
+    Logger();
+
+    ThreadBuffer *local_buffer();
+
+    ThreadBuffer *acquire_buffer();
+
+    void drain_routine();
+
+    size_t drain();
+
+private:
+    rw_lock buffers_lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    std::mutex drain_lock;
+    std::vector<LogRecord> batch;
+    std::string output;
+
+    std::atomic<uint64_t> dropped_records{0};
+    uint64_t reported_dropped_records = 0;
+
+    bool running = true;
+    std::mutex drainer_lock;
+    std::condition_variable drainer_waiter;
+    std::thread drainer;
+};
+
+#define LOG_AT(level, color, ...)                                       \
+    do {                                                                \
+        if constexpr (static_cast<int32_t>(level) >= LAB2_LOG_LEVEL)    \
+            Logger::instance().log(color, __VA_ARGS__);                 \
+    } while (0)
+
+#define LOG_DEBUG(color, ...) LOG_AT(LogLevel::debug, color, __VA_ARGS__)
+#define LOG_INFO(color, ...) LOG_AT(LogLevel::info, color, __VA_ARGS__)
+#define LOG_WARNING(color, ...) LOG_AT(LogLevel::warning, color, __VA_ARGS__)
+#define LOG_ERROR(color, ...) LOG_AT(LogLevel::error, color, __VA_ARGS__)
+
+#endif //LAB2_LOGGER_H
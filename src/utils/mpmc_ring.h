@@ -0,0 +1,142 @@
+#ifndef LAB2_MPMC_RING_H
+#define LAB2_MPMC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free FIFO for any number of producers and consumers. Every slot carries a sequence
+// number that says whose turn it is: position for the producer that may fill it,
+// position + 1 for the consumer that may empty it. push fails instead of waiting when the ring is full.
+template <typename T>
+class MpmcRing {
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+public:
+    // a thread pool queue that is bounded may refuse a push, one that is not erasable cannot
+    // give up a task before it is popped, so tasks in it are neither promoted nor cancelled
+    static constexpr bool bounded = true;
+    static constexpr bool erasable = false;
+
+    static constexpr size_t default_capacity = 4096;
+
+    // the capacity is rounded up to a power of two, so that a position maps to its slot with a mask
+    explicit MpmcRing(size_t capacity = default_capacity) {
+        this->capacity = 2;
+        while (this->capacity < capacity)
+            this->capacity *= 2;
+
+        this->mask = this->capacity - 1;
+        this->slots = std::make_unique<Slot[]>(this->capacity);
+
+        for (size_t i = 0; i < this->capacity; i++)
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    inline ~MpmcRing() { clear(); }
+
+    bool push(const T &value);
+
+    bool pop(T &out_value);
+
+    // stops at the first element that does not fit, returns how many were pushed
+    template <typename Iterator>
+    size_t push_bulk(Iterator first, Iterator last) {
+        size_t pushed = 0;
+        for (; first != last && this->push(*first); ++first)
+            pushed++;
+
+        return pushed;
+    }
+
+    [[nodiscard]] size_t get_capacity() const {
+        return this->capacity;
+    }
+
+    // exact only while nobody pushes or pops
+    size_t size() const {
+        auto tail = this->tail.load(std::memory_order_acquire);
+        auto head = this->head.load(std::memory_order_acquire);
+
+        return head > tail ? head - tail : 0;
+    }
+
+    bool empty() const {
+        return this->size() == 0;
+    }
+
+    void clear() {
+        T value;
+        while (this->pop(value))
+            value = T{};
+    }
+
+public:
+    MpmcRing(MpmcRing const &other) = delete;
+
+    MpmcRing &operator=(MpmcRing const &rhs) = delete;
+
+private:
+    size_t capacity;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    alignas(64) std::unique_ptr<Slot[]> slots;
+};
+
+template <typename T>
+bool MpmcRing<T>::push(const T &value) {
+    auto position = this->head.load(std::memory_order_relaxed);
+
+    while (true) {
+        auto &slot = this->slots[position & this->mask];
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0) {
+            if (this->head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.value = value;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            // the consumer of the previous lap has not emptied the slot yet
+            return false;
+        } else {
+            position = this->head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+bool MpmcRing<T>::pop(T &out_value) {
+    auto position = this->tail.load(std::memory_order_relaxed);
+
+    while (true) {
+        auto &slot = this->slots[position & this->mask];
+        auto sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = (intptr_t) sequence - (intptr_t) (position + 1);
+
+        if (difference == 0) {
+            if (this->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                out_value = std::move(slot.value);
+                // releases whatever the slot held before a producer of the next lap can see it free
+                slot.value = T{};
+                slot.sequence.store(position + this->capacity, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = this->tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif //LAB2_MPMC_RING_H
@@ -0,0 +1,158 @@
+#ifndef LAB2_PARKER_H
+#define LAB2_PARKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#endif
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Wake flag a single thread parks on. park() spins on the flag for a short while, then yields,
+// and only then sleeps in a futex, so a wakeup that comes quickly costs neither side a syscall.
+class Parker {
+    static constexpr uint32_t spin_iterations = 256;
+    static constexpr uint32_t yield_iterations = 8;
+
+    enum : uint32_t {
+        empty = 0,
+        notified = 1,
+        sleeping = 2
+    };
+
+public:
+    // forgets an earlier notification, called before the owner announces it is about to park
+    void prepare() {
+        this->state.store(empty, std::memory_order_relaxed);
+    }
+
+    // returns once unpark was called after the last prepare
+    void park() {
+        for (uint32_t i = 0; i < spin_iterations; i++) {
+            if (this->state.load(std::memory_order_acquire) == notified)
+                return;
+
+            cpu_relax();
+        }
+
+        for (uint32_t i = 0; i < yield_iterations; i++) {
+            if (this->state.load(std::memory_order_acquire) == notified)
+                return;
+
+            std::this_thread::yield();
+        }
+
+        uint32_t expected = empty;
+        if (!this->state.compare_exchange_strong(expected, sleeping, std::memory_order_acq_rel))
+            return;
+
+#ifdef __linux__
+        while (this->state.load(std::memory_order_acquire) == sleeping)
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->state), FUTEX_WAIT_PRIVATE, sleeping,
+                    nullptr, nullptr, 0);
+#else
+        std::unique_lock _(this->lock);
+        this->waiter.wait(_, [this]() { return this->state.load(std::memory_order_acquire) == notified; });
+#endif
+    }
+
+    void unpark() {
+        if (this->state.exchange(notified, std::memory_order_acq_rel) != sleeping)
+            return;
+
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        std::lock_guard _(this->lock);
+        this->waiter.notify_one();
+#endif
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> state{empty};
+
+#ifndef __linux__
+    std::mutex lock;
+    std::condition_variable waiter;
+#endif
+};
+
+// Stack of parked worker ids. Wakers look at the atomic count before taking the lock,
+// so a producer that finds nobody asleep pays a fence and a load.
+class IdleWorkers {
+public:
+    void push(uint32_t worker) {
+        std::lock_guard _(this->lock);
+
+        this->workers.push_back(worker);
+        this->parked.fetch_add(1, std::memory_order_relaxed);
+
+        // the caller re-checks for work next, see wake
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    // false when a waker has already taken the worker off the stack
+    bool remove(uint32_t worker) {
+        std::lock_guard _(this->lock);
+
+        for (size_t i = 0; i < this->workers.size(); i++) {
+            if (this->workers[i] != worker)
+                continue;
+
+            this->workers.erase(this->workers.begin() + i);
+            this->parked.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    // hands up to max workers to wake, the most recently parked and so the warmest first
+    template <typename FT>
+    size_t wake(size_t max, FT wake_worker) {
+        // pairs with push: either the waker sees the worker or the worker sees what the waker published
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (max == 0 || this->parked.load(std::memory_order_relaxed) == 0)
+            return 0;
+
+        std::lock_guard _(this->lock);
+
+        size_t woken = 0;
+        for (; woken < max && !this->workers.empty(); woken++) {
+            wake_worker(this->workers.back());
+
+            this->workers.pop_back();
+            this->parked.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        return woken;
+    }
+
+    [[nodiscard]] uint32_t size() const {
+        return this->parked.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> parked{0};
+
+    std::mutex lock;
+    std::vector<uint32_t> workers;
+};
+
+#endif //LAB2_PARKER_H
@@ -0,0 +1,109 @@
+#ifndef LAB2_SLAB_ALLOCATOR_H
+#define LAB2_SLAB_ALLOCATOR_H
+
+#include "concurrent_queue.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Object pool for intrusively counted nodes. Nodes are allocated chunk by chunk, never returned
+// to the heap while the pool lives, and come back to the free list when their last IntrusivePtr dies.
+// A recycled node is reset to T{} and its intrusive_hook.generation is bumped, so a raw pointer
+// plus generation works as a weak reference.
+template <typename T>
+class SlabAllocator {
+public:
+    explicit SlabAllocator(size_t chunk_size = 256) {
+        this->chunk_size = chunk_size;
+    }
+
+    ~SlabAllocator() = default;
+
+    // moves value into a recycled node when one is free, reused tells whether it was
+    IntrusivePtr<T> make(T &&value, bool &reused);
+
+    [[nodiscard]] uint64_t get_allocations() const {
+        return this->allocations.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t get_reused_allocations() const {
+        return this->reused_allocations.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t get_capacity() const {
+        std::lock_guard _(this->free_list_lock);
+        return this->chunks.size() * this->chunk_size;
+    }
+
+public:
+    SlabAllocator(SlabAllocator const &other) = delete;
+
+    SlabAllocator &operator=(SlabAllocator const &rhs) = delete;
+
+private:
+    size_t chunk_size;
+
+    mutable std::mutex free_list_lock;
+    std::vector<T *> free_nodes;
+    std::vector<std::unique_ptr<T[]>> chunks;
+
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> reused_allocations{0};
+
+    static void recycle(void *object, void *context);
+
+    T *take_node(bool &reused);
+};
+
+template <typename T>
+T *SlabAllocator<T>::take_node(bool &reused) {
+    std::lock_guard _(this->free_list_lock);
+
+    reused = !this->free_nodes.empty();
+
+    if (!reused) {
+        this->chunks.push_back(std::make_unique<T[]>(this->chunk_size));
+        this->free_nodes.reserve(this->chunks.size() * this->chunk_size);
+
+        auto chunk = this->chunks.back().get();
+        for (size_t i = this->chunk_size; i-- > 0;) {
+            chunk[i].intrusive_hook.recycle = &SlabAllocator::recycle;
+            chunk[i].intrusive_hook.recycle_context = this;
+            this->free_nodes.push_back(&chunk[i]);
+        }
+    }
+
+    auto node = this->free_nodes.back();
+    this->free_nodes.pop_back();
+
+    return node;
+}
+
+template <typename T>
+IntrusivePtr<T> SlabAllocator<T>::make(T &&value, bool &reused) {
+    auto node = this->take_node(reused);
+    *node = std::move(value);
+
+    this->allocations.fetch_add(1, std::memory_order_relaxed);
+    if (reused)
+        this->reused_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    return IntrusivePtr<T>(node);
+}
+
+template <typename T>
+void SlabAllocator<T>::recycle(void *object, void *context) {
+    auto node = static_cast<T *>(object);
+    auto allocator = static_cast<SlabAllocator *>(context);
+
+    // drops whatever the old value captured before the node is visible to anybody else
+    *node = T{};
+    node->intrusive_hook.generation.fetch_add(1, std::memory_order_release);
+
+    std::lock_guard _(allocator->free_list_lock);
+    allocator->free_nodes.push_back(node);
+}
+
+#endif //LAB2_SLAB_ALLOCATOR_H
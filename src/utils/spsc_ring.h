@@ -0,0 +1,59 @@
+#ifndef LAB2_SPSC_RING_H
+#define LAB2_SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free ring for exactly one producer and one consumer thread.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    bool push(const T &value) {
+        auto head = this->head.load(std::memory_order_relaxed);
+        if (head - this->cached_tail == Capacity) {
+            this->cached_tail = this->tail.load(std::memory_order_acquire);
+            if (head - this->cached_tail == Capacity)
+                return false;
+        }
+
+        this->slots[head & (Capacity - 1)] = value;
+        this->head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(T &out_value) {
+        auto tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == this->head.load(std::memory_order_acquire))
+            return false;
+
+        out_value = this->slots[tail & (Capacity - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool empty() const {
+        return this->tail.load(std::memory_order_acquire) == this->head.load(std::memory_order_acquire);
+    }
+
+public:
+    SpscRing(SpscRing const &other) = delete;
+
+    SpscRing &operator=(SpscRing const &rhs) = delete;
+
+private:
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cached_tail = 0;
+
+    alignas(64) std::atomic<size_t> tail{0};
+
+    std::array<T, Capacity> slots{};
+};
+
+#endif //LAB2_SPSC_RING_H
@@ -0,0 +1,118 @@
+#ifndef LAB2_TASK_FUNCTION_H
+#define LAB2_TASK_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Move-only replacement for std::function<void()>. Callables up to inline_capacity bytes
+// that are nothrow movable live inside the object, larger ones fall back to the heap.
+class TaskFunction {
+public:
+    static constexpr size_t inline_capacity = 64;
+
+    template <typename FT>
+    static constexpr bool stored_inline = sizeof(FT) <= inline_capacity
+                                          && alignof(FT) <= alignof(std::max_align_t)
+                                          && std::is_nothrow_move_constructible_v<FT>;
+
+    TaskFunction() = default;
+
+    template <typename FT, typename = std::enable_if_t<!std::is_same_v<std::decay_t<FT>, TaskFunction>>>
+    TaskFunction(FT &&func) {
+        using callable_type = std::decay_t<FT>;
+
+        if constexpr (stored_inline<callable_type>) {
+            new(&this->storage) callable_type(std::forward<FT>(func));
+        } else {
+            *reinterpret_cast<callable_type **>(&this->storage) = new callable_type(std::forward<FT>(func));
+        }
+
+        this->operations = &operations_for<callable_type>;
+    }
+
+    TaskFunction(TaskFunction &&other) noexcept {
+        this->take(std::move(other));
+    }
+
+    TaskFunction &operator=(TaskFunction &&rhs) noexcept {
+        if (this != &rhs) {
+            this->reset();
+            this->take(std::move(rhs));
+        }
+
+        return *this;
+    }
+
+    inline ~TaskFunction() { reset(); }
+
+    void operator()() {
+        this->operations->invoke(&this->storage);
+    }
+
+    explicit operator bool() const {
+        return this->operations != nullptr;
+    }
+
+    void reset() {
+        if (this->operations) {
+            this->operations->destroy(&this->storage);
+            this->operations = nullptr;
+        }
+    }
+
+public:
+    TaskFunction(TaskFunction const &other) = delete;
+
+    TaskFunction &operator=(TaskFunction const &rhs) = delete;
+
+private:
+    struct Operations {
+        void (*invoke)(void *storage);
+
+        void (*move)(void *destination, void *source);
+
+        void (*destroy)(void *storage);
+    };
+
+    template <typename FT>
+    static FT *target(void *storage) {
+        if constexpr (stored_inline<FT>)
+            return std::launder(reinterpret_cast<FT *>(storage));
+        else
+            return *reinterpret_cast<FT **>(storage);
+    }
+
+    template <typename FT>
+    static constexpr Operations operations_for{
+            [](void *storage) { (*target<FT>(storage))(); },
+            [](void *destination, void *source) {
+                if constexpr (stored_inline<FT>) {
+                    new(destination) FT(std::move(*target<FT>(source)));
+                    target<FT>(source)->~FT();
+                } else {
+                    *reinterpret_cast<FT **>(destination) = target<FT>(source);
+                }
+            },
+            [](void *storage) {
+                if constexpr (stored_inline<FT>)
+                    target<FT>(storage)->~FT();
+                else
+                    delete target<FT>(storage);
+            },
+    };
+
+    void take(TaskFunction &&other) {
+        if (other.operations) {
+            other.operations->move(&this->storage, &other.storage);
+            this->operations = other.operations;
+            other.operations = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[inline_capacity];
+    const Operations *operations = nullptr;
+};
+
+#endif //LAB2_TASK_FUNCTION_H
@@ -0,0 +1,360 @@
+#ifndef LAB2_TELEMETRY_H
+#define LAB2_TELEMETRY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Log-linear buckets: every power of two is split into 4 sub-buckets, so a bucket is at most 25% wide.
+struct HistogramSnapshot {
+    static constexpr uint32_t sub_bucket_bits = 2;
+    static constexpr uint32_t sub_buckets_num = 1u << sub_bucket_bits;
+    static constexpr uint32_t buckets_num = 64 * sub_buckets_num;
+
+    std::array<uint64_t, buckets_num> buckets{};
+
+    static uint32_t bucket_of(uint64_t value) {
+        if (value < sub_buckets_num)
+            return value;
+
+        uint32_t msb = 63 - __builtin_clzll(value);
+        uint32_t sub_bucket = (value >> (msb - sub_bucket_bits)) & (sub_buckets_num - 1);
+
+        return (msb - sub_bucket_bits + 1) * sub_buckets_num + sub_bucket;
+    }
+
+    static uint64_t bucket_lower_bound(uint32_t bucket) {
+        if (bucket < sub_buckets_num)
+            return bucket;
+
+        uint32_t shift = bucket / sub_buckets_num - 1;
+        return (uint64_t) (sub_buckets_num + bucket % sub_buckets_num) << shift;
+    }
+
+    static uint64_t bucket_upper_bound(uint32_t bucket) {
+        if (bucket < sub_buckets_num)
+            return bucket;
+
+        return bucket_lower_bound(bucket) + (1ull << (bucket / sub_buckets_num - 1)) - 1;
+    }
+
+    [[nodiscard]] uint64_t count() const {
+        uint64_t total = 0;
+        for (auto bucket: this->buckets)
+            total += bucket;
+
+        return total;
+    }
+
+    // midpoint of the bucket holding the requested rank, 0 when nothing was recorded
+    [[nodiscard]] double percentile(double fraction) const {
+        auto total = this->count();
+        if (total == 0)
+            return 0;
+
+        auto rank = (uint64_t) (fraction * (double) total);
+        if (rank >= total)
+            rank = total - 1;
+
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < buckets_num; i++) {
+            seen += this->buckets[i];
+            if (seen > rank)
+                return ((double) bucket_lower_bound(i) + (double) bucket_upper_bound(i)) / 2;
+        }
+
+        return (double) bucket_upper_bound(buckets_num - 1);
+    }
+};
+
+class LatencyHistogram {
+public:
+    void record(uint64_t value) {
+        this->buckets[HistogramSnapshot::bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void add_to(HistogramSnapshot &snapshot) const {
+        for (uint32_t i = 0; i < HistogramSnapshot::buckets_num; i++)
+            snapshot.buckets[i] += this->buckets[i].load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::buckets_num> buckets{};
+};
+
+struct TelemetrySnapshot {
+    uint64_t total_sleep_time_us = 0;
+    uint64_t total_execution_time_us = 0;
+
+    uint64_t main_queue_size = 0;
+    uint64_t main_queue_size_measurements = 0;
+
+    uint64_t secondary_queue_size = 0;
+    uint64_t secondary_queue_size_measurements = 0;
+
+    uint64_t tasks_completed = 0;
+    uint64_t tasks_scheduled = 0;
+
+    uint64_t tasks_stolen = 0;
+    uint64_t steal_attempts = 0;
+
+    uint64_t total_dequeue_time_ns = 0;
+    uint64_t dequeues = 0;
+
+    uint64_t task_allocations = 0;
+    uint64_t task_allocations_reused = 0;
+
+    uint64_t tasks_expired = 0;
+    uint64_t tasks_cancelled = 0;
+
+    uint64_t tasks_rejected = 0;
+    uint64_t tasks_evicted = 0;
+    uint64_t tasks_run_by_caller = 0;
+
+    // all in microseconds
+    HistogramSnapshot queue_wait{};
+    HistogramSnapshot execution_time{};
+    HistogramSnapshot sleep_time{};
+
+    [[nodiscard]] uint64_t get_total_sleep_time() const {
+        return this->total_sleep_time_us / 1000;
+    }
+
+    [[nodiscard]] double get_avg_main_queue_size() const {
+        return (double) this->main_queue_size / this->main_queue_size_measurements;
+    }
+
+    [[nodiscard]] double get_avg_secondary_queue_size() const {
+        return (double) this->secondary_queue_size / this->secondary_queue_size_measurements;
+    }
+
+    [[nodiscard]] uint64_t get_scheduled_tasks() const {
+        return this->tasks_scheduled;
+    }
+
+    [[nodiscard]] uint64_t get_completed_tasks() const {
+        return this->tasks_completed;
+    }
+
+    [[nodiscard]] double get_avg_task_execution_time() const {
+        return (double) this->total_execution_time_us / 1000 / this->tasks_completed;
+    }
+
+    [[nodiscard]] uint64_t get_stolen_tasks() const {
+        return this->tasks_stolen;
+    }
+
+    [[nodiscard]] uint64_t get_steal_attempts() const {
+        return this->steal_attempts;
+    }
+
+    [[nodiscard]] double get_avg_dequeue_time_us() const {
+        return (double) this->total_dequeue_time_ns / 1000 / this->dequeues;
+    }
+
+    // share of task nodes served by a recycled slab node
+    [[nodiscard]] double get_allocator_hit_rate() const {
+        return (double) this->task_allocations_reused / this->task_allocations;
+    }
+
+    [[nodiscard]] uint64_t get_expired_tasks() const {
+        return this->tasks_expired;
+    }
+
+    [[nodiscard]] uint64_t get_cancelled_tasks() const {
+        return this->tasks_cancelled;
+    }
+
+    // refused by add_task, the producer keeps the task
+    [[nodiscard]] uint64_t get_rejected_tasks() const {
+        return this->tasks_rejected;
+    }
+
+    // queued tasks dropped to make room for ones with a shorter wait_time
+    [[nodiscard]] uint64_t get_evicted_tasks() const {
+        return this->tasks_evicted;
+    }
+
+    [[nodiscard]] uint64_t get_tasks_run_by_caller() const {
+        return this->tasks_run_by_caller;
+    }
+};
+
+inline std::atomic<uint32_t> telemetry_shards_assigned{0};
+
+// Writers only touch the shard of their own thread with relaxed atomics, readers sum all shards.
+class Telemetry {
+    static constexpr uint32_t shards_num = 16;
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> total_sleep_time_us{0};
+        std::atomic<uint64_t> total_execution_time_us{0};
+
+        std::atomic<uint64_t> main_queue_size{0};
+        std::atomic<uint64_t> main_queue_size_measurements{0};
+
+        std::atomic<uint64_t> secondary_queue_size{0};
+        std::atomic<uint64_t> secondary_queue_size_measurements{0};
+
+        std::atomic<uint64_t> tasks_completed{0};
+        std::atomic<uint64_t> tasks_scheduled{0};
+
+        std::atomic<uint64_t> tasks_stolen{0};
+        std::atomic<uint64_t> steal_attempts{0};
+
+        std::atomic<uint64_t> total_dequeue_time_ns{0};
+        std::atomic<uint64_t> dequeues{0};
+
+        std::atomic<uint64_t> task_allocations{0};
+        std::atomic<uint64_t> task_allocations_reused{0};
+
+        std::atomic<uint64_t> tasks_expired{0};
+        std::atomic<uint64_t> tasks_cancelled{0};
+
+        std::atomic<uint64_t> tasks_rejected{0};
+        std::atomic<uint64_t> tasks_evicted{0};
+        std::atomic<uint64_t> tasks_run_by_caller{0};
+
+        LatencyHistogram queue_wait{};
+        LatencyHistogram execution_time{};
+        LatencyHistogram sleep_time{};
+    };
+
+public:
+    Telemetry() = default;
+
+    void add_task(uint64_t tasks_num = 1) {
+        bump(this->local_shard().tasks_scheduled, tasks_num);
+    }
+
+    void task_completed(std::chrono::microseconds execution_time) {
+        auto &shard = this->local_shard();
+
+        bump(shard.tasks_completed);
+        bump(shard.total_execution_time_us, execution_time.count());
+        shard.execution_time.record(execution_time.count());
+    }
+
+    void update_queue_wait(std::chrono::microseconds queue_wait) {
+        this->local_shard().queue_wait.record(queue_wait.count() > 0 ? queue_wait.count() : 0);
+    }
+
+    void update_wait_time(std::chrono::microseconds time_waited) {
+        auto &shard = this->local_shard();
+
+        bump(shard.total_sleep_time_us, time_waited.count());
+        shard.sleep_time.record(time_waited.count());
+    }
+
+    void update_main_queue_size(uint32_t current_queue_size) {
+        auto &shard = this->local_shard();
+
+        bump(shard.main_queue_size_measurements);
+        bump(shard.main_queue_size, current_queue_size);
+    }
+
+    void update_secondary_queue_size(uint32_t current_queue_size) {
+        auto &shard = this->local_shard();
+
+        bump(shard.secondary_queue_size_measurements);
+        bump(shard.secondary_queue_size, current_queue_size);
+    }
+
+    void steal_attempted(bool succeeded) {
+        auto &shard = this->local_shard();
+
+        bump(shard.steal_attempts);
+        if (succeeded)
+            bump(shard.tasks_stolen);
+    }
+
+    void update_dequeue_time(std::chrono::nanoseconds dequeue_time) {
+        auto &shard = this->local_shard();
+
+        bump(shard.dequeues);
+        bump(shard.total_dequeue_time_ns, dequeue_time.count());
+    }
+
+    void tasks_allocated(uint64_t allocations, uint64_t reused) {
+        auto &shard = this->local_shard();
+
+        bump(shard.task_allocations, allocations);
+        bump(shard.task_allocations_reused, reused);
+    }
+
+    void task_expired() {
+        bump(this->local_shard().tasks_expired);
+    }
+
+    void task_cancelled() {
+        bump(this->local_shard().tasks_cancelled);
+    }
+
+    void tasks_rejected(uint64_t tasks_num = 1) {
+        bump(this->local_shard().tasks_rejected, tasks_num);
+    }
+
+    void task_evicted() {
+        bump(this->local_shard().tasks_evicted);
+    }
+
+    void task_run_by_caller() {
+        bump(this->local_shard().tasks_run_by_caller);
+    }
+
+    [[nodiscard]] TelemetrySnapshot snapshot() const {
+        TelemetrySnapshot result{};
+
+        for (auto &shard: this->shards) {
+            result.total_sleep_time_us += read(shard.total_sleep_time_us);
+            result.total_execution_time_us += read(shard.total_execution_time_us);
+            result.main_queue_size += read(shard.main_queue_size);
+            result.main_queue_size_measurements += read(shard.main_queue_size_measurements);
+            result.secondary_queue_size += read(shard.secondary_queue_size);
+            result.secondary_queue_size_measurements += read(shard.secondary_queue_size_measurements);
+            result.tasks_completed += read(shard.tasks_completed);
+            result.tasks_scheduled += read(shard.tasks_scheduled);
+            result.tasks_stolen += read(shard.tasks_stolen);
+            result.steal_attempts += read(shard.steal_attempts);
+            result.total_dequeue_time_ns += read(shard.total_dequeue_time_ns);
+            result.dequeues += read(shard.dequeues);
+            result.task_allocations += read(shard.task_allocations);
+            result.task_allocations_reused += read(shard.task_allocations_reused);
+            result.tasks_expired += read(shard.tasks_expired);
+            result.tasks_cancelled += read(shard.tasks_cancelled);
+            result.tasks_rejected += read(shard.tasks_rejected);
+            result.tasks_evicted += read(shard.tasks_evicted);
+            result.tasks_run_by_caller += read(shard.tasks_run_by_caller);
+
+            shard.queue_wait.add_to(result.queue_wait);
+            shard.execution_time.add_to(result.execution_time);
+            shard.sleep_time.add_to(result.sleep_time);
+        }
+
+        return result;
+    }
+
+public:
+    Telemetry(Telemetry const &other) = delete;
+
+    Telemetry &operator=(Telemetry const &rhs) = delete;
+
+private:
+    std::array<Shard, shards_num> shards{};
+
+    Shard &local_shard() {
+        thread_local uint32_t shard_index = telemetry_shards_assigned.fetch_add(1, std::memory_order_relaxed);
+        return this->shards[shard_index % shards_num];
+    }
+
+    static void bump(std::atomic<uint64_t> &counter, uint64_t value = 1) {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static uint64_t read(const std::atomic<uint64_t> &counter) {
+        return counter.load(std::memory_order_relaxed);
+    }
+};
+
+#endif //LAB2_TELEMETRY_H
@@ -0,0 +1,181 @@
+#ifndef LAB2_TIMER_WHEEL_H
+#define LAB2_TIMER_WHEEL_H
+
+#include "clock.h"
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Hierarchical timing wheel: four levels of 64 slots at 1 ms resolution cover ~4.6 hours,
+// anything further away is parked in the last level and re-cascaded until it is due.
+// Not synchronized, the owner guards it.
+template <typename T>
+class TimerWheel {
+    using clock = Clock;
+
+    static constexpr uint32_t slot_bits = 6;
+    static constexpr uint32_t slots_num = 1u << slot_bits;
+    static constexpr uint32_t slot_mask = slots_num - 1;
+    static constexpr uint32_t levels_num = 4;
+    static constexpr uint64_t max_delta = (1ull << (slot_bits * levels_num)) - 1;
+
+    struct Entry {
+        uint64_t expiry_tick;
+        T value;
+    };
+
+    using slot_implementation = std::vector<Entry>;
+
+public:
+    explicit TimerWheel(clock::time_point origin = clock::now()) {
+        this->origin = origin;
+    }
+
+    bool empty() const { return this->entries_num == 0; }
+
+    size_t size() const { return this->entries_num; }
+
+    // never later than the earliest expiry: the first non-empty slot of the lowest level,
+    // or the next cascade when that level is empty. time_point::max() for an empty wheel
+    clock::time_point next_due() const;
+
+public:
+    void schedule(clock::time_point deadline, T value);
+
+    template <typename FT>
+    size_t advance(clock::time_point now, FT on_expired);
+
+public:
+    TimerWheel(TimerWheel const &other) = delete;
+
+    TimerWheel &operator=(TimerWheel const &rhs) = delete;
+
+private:
+    clock::time_point origin;
+
+    // the next tick to be processed
+    uint64_t current_tick = 0;
+    size_t entries_num = 0;
+
+    std::array<std::array<slot_implementation, slots_num>, levels_num> wheels;
+
+    // slots are swapped with these instead of moved out, so no slot ever gives its buffer back
+    std::array<slot_implementation, levels_num> scratch;
+
+    uint64_t to_tick(clock::time_point point) const {
+        if (point <= this->origin)
+            return 0;
+
+        return std::chrono::duration_cast<std::chrono::milliseconds>(point - this->origin).count();
+    }
+
+    void place(Entry &&entry);
+
+    void cascade(uint32_t level);
+};
+
+template <typename T>
+void TimerWheel<T>::schedule(clock::time_point deadline, T value) {
+    this->place(Entry{this->to_tick(deadline), std::move(value)});
+    this->entries_num++;
+}
+
+template <typename T>
+void TimerWheel<T>::place(Entry &&entry) {
+    uint64_t expiry = entry.expiry_tick;
+
+    if (expiry < this->current_tick)
+        expiry = this->current_tick;
+    else if (expiry - this->current_tick > max_delta)
+        expiry = this->current_tick + max_delta;
+
+    uint64_t delta = expiry - this->current_tick;
+
+    uint32_t level = 0;
+    while (level + 1 < levels_num && delta >= (1ull << (slot_bits * (level + 1))))
+        level++;
+
+    auto slot = (expiry >> (slot_bits * level)) & slot_mask;
+    this->wheels[level][slot].push_back(std::move(entry));
+}
+
+template <typename T>
+void TimerWheel<T>::cascade(uint32_t level) {
+    auto slot = (this->current_tick >> (slot_bits * level)) & slot_mask;
+
+    auto &entries = this->scratch[level];
+    entries.swap(this->wheels[level][slot]);
+
+    for (auto &entry: entries)
+        this->place(std::move(entry));
+
+    entries.clear();
+
+    if (slot == 0 && level + 1 < levels_num)
+        this->cascade(level + 1);
+}
+
+template <typename T>
+typename TimerWheel<T>::clock::time_point TimerWheel<T>::next_due() const {
+    if (this->entries_num == 0)
+        return clock::time_point::max();
+
+    // entries of higher levels expire no sooner than the tick their slot is cascaded at
+    uint64_t cascade_tick = (this->current_tick | slot_mask) + 1;
+
+    uint64_t tick = this->current_tick;
+    for (; tick < cascade_tick; tick++)
+        if (!this->wheels[0][tick & slot_mask].empty())
+            break;
+
+    return this->origin + std::chrono::milliseconds(tick);
+}
+
+template <typename T>
+template <typename FT>
+size_t TimerWheel<T>::advance(clock::time_point now, FT on_expired) {
+    uint64_t now_tick = this->to_tick(now);
+    size_t expired = 0;
+
+    if (this->entries_num == 0) {
+        if (now_tick >= this->current_tick)
+            this->current_tick = now_tick + 1;
+
+        return 0;
+    }
+
+    while (this->current_tick <= now_tick && this->entries_num > 0) {
+        auto slot = this->current_tick & slot_mask;
+
+        if (slot == 0)
+            this->cascade(1);
+
+        auto &entries = this->scratch[0];
+        entries.swap(this->wheels[0][slot]);
+
+        for (auto &entry: entries) {
+            if (entry.expiry_tick > this->current_tick) {
+                // clamped entry that is still too far away
+                this->place(std::move(entry));
+                continue;
+            }
+
+            this->entries_num--;
+            expired++;
+            on_expired(entry.value);
+        }
+
+        entries.clear();
+
+        this->current_tick++;
+    }
+
+    if (this->entries_num == 0 && now_tick >= this->current_tick)
+        this->current_tick = now_tick + 1;
+
+    return expired;
+}
+
+#endif //LAB2_TIMER_WHEEL_H
@@ -0,0 +1,141 @@
+#include "tracer.h"
+
+#include <algorithm>
+
+namespace {
+    thread_local std::string thread_name;
+
+    struct BufferLease {
+        std::atomic<bool> *released = nullptr;
+
+        ~BufferLease() {
+            if (this->released)
+                this->released->store(true, std::memory_order_release);
+        }
+    };
+
+    uint64_t to_microseconds(Clock::time_point timestamp) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch()).count();
+    }
+}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::name_current_thread(const std::string &name) {
+    thread_name = name;
+}
+
+Tracer::ThreadBuffer *Tracer::local_buffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    thread_local BufferLease lease;
+
+    if (!buffer) {
+        buffer = this->acquire_buffer();
+        lease.released = &buffer->released;
+    }
+
+    return buffer;
+}
+
+Tracer::ThreadBuffer *Tracer::acquire_buffer() {
+    write_lock _(this->buffers_lock);
+
+    ThreadBuffer *buffer = nullptr;
+
+    // rings of exited threads are handed over, events they still hold keep the new thread's name
+    for (auto &candidate: this->buffers) {
+        if (candidate->released.load(std::memory_order_acquire)) {
+            candidate->released.store(false, std::memory_order_relaxed);
+            buffer = candidate.get();
+            break;
+        }
+    }
+
+    if (!buffer) {
+        this->buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = this->buffers.back().get();
+        buffer->track = this->buffers.size();
+    }
+
+    buffer->name = thread_name.empty() ? "thread " + std::to_string(buffer->track) : thread_name;
+
+    return buffer;
+}
+
+void Tracer::write_chrome_trace(std::ostream &out) {
+    std::lock_guard _(this->drain_lock);
+
+    std::string output = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    char line[256];
+    bool first = true;
+
+    auto append = [&](int length) {
+        if (!first)
+            output += ",\n";
+
+        output.append(line, std::min<size_t>(std::max(length, 0), sizeof(line) - 1));
+        first = false;
+    };
+
+    read_lock _b(this->buffers_lock);
+
+    for (auto &buffer: this->buffers) {
+        append(snprintf(line, sizeof(line),
+                        R"({"ph": "M", "name": "thread_name", "pid": 1, "tid": %u, "args": {"name": "%s"}})",
+                        buffer->track, buffer->name.c_str()));
+
+        TraceEvent event{};
+        while (buffer->ring.pop(event)) {
+            auto ts = (unsigned long long) to_microseconds(event.timestamp);
+            auto object = (unsigned long long) reinterpret_cast<uintptr_t>(event.object);
+
+            switch (event.kind) {
+                // queue wait is an async span per task node, so it shows apart from the worker tracks
+                case TraceEventKind::enqueue:
+                case TraceEventKind::dequeue:
+                case TraceEventKind::cancel:
+                case TraceEventKind::reject: {
+                    auto outcome = event.kind == TraceEventKind::cancel ? ", \"cancelled\": true"
+                                   : event.kind == TraceEventKind::reject ? ", \"rejected\": true" : "";
+
+                    append(snprintf(line, sizeof(line),
+                                    R"({"ph": "%s", "cat": "queue", "name": "queued", "id": "0x%llx", )"
+                                    R"("pid": 1, "tid": %u, "ts": %llu, "args": {"task": %u%s}})",
+                                    event.kind == TraceEventKind::enqueue ? "b" : "e", object, buffer->track, ts,
+                                    event.task_id, outcome));
+                    break;
+                }
+                case TraceEventKind::start:
+                    append(snprintf(line, sizeof(line),
+                                    R"({"ph": "B", "name": "task %u", "pid": 1, "tid": %u, "ts": %llu, )"
+                                    R"("args": {"level": %u}})",
+                                    event.task_id, buffer->track, ts, event.detail));
+                    break;
+                case TraceEventKind::finish:
+                case TraceEventKind::unpark:
+                    append(snprintf(line, sizeof(line), R"({"ph": "E", "pid": 1, "tid": %u, "ts": %llu})",
+                                    buffer->track, ts));
+                    break;
+                case TraceEventKind::park:
+                    append(snprintf(line, sizeof(line),
+                                    R"({"ph": "B", "name": "idle", "pid": 1, "tid": %u, "ts": %llu})",
+                                    buffer->track, ts));
+                    break;
+                case TraceEventKind::promote:
+                case TraceEventKind::expire:
+                    append(snprintf(line, sizeof(line),
+                                    R"({"ph": "i", "s": "t", "name": "%s", "pid": 1, "tid": %u, "ts": %llu, )"
+                                    R"("args": {"task": %u, "level": %u}})",
+                                    event.kind == TraceEventKind::promote ? "promoted" : "expired",
+                                    buffer->track, ts, event.task_id, event.detail));
+                    break;
+            }
+        }
+    }
+
+    output += "\n]}\n";
+    out << output << std::flush;
+}
@@ -0,0 +1,106 @@
+#ifndef LAB2_TRACER_H
+#define LAB2_TRACER_H
+
+#include "helper.h"
+#include "spsc_ring.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class TraceEventKind : uint32_t {
+    enqueue,
+    dequeue,
+    start,
+    finish,
+    // detail is the level the task moved up to
+    promote,
+    expire,
+    cancel,
+    // the pool gave the task back or dropped it without running it
+    reject,
+    park,
+    unpark
+};
+
+struct TraceEvent {
+    Clock::time_point timestamp;
+    // the task node, unique among the tasks alive at a time unlike the ids of tasks built outside the pool
+    const void *object;
+    uint32_t task_id;
+    uint32_t detail;
+    TraceEventKind kind;
+};
+
+// Task lifecycle events for a timeline. Every thread records into its own lock-free ring, which is
+// only allocated once the thread records with tracing on, and a full ring drops the event.
+// write_chrome_trace drains all rings into Chrome trace-event JSON, as chrome://tracing and Perfetto read it.
+class Tracer {
+    static constexpr size_t ring_capacity = 16384;
+
+    struct ThreadBuffer {
+        SpscRing<TraceEvent, ring_capacity> ring;
+        std::atomic<bool> released{false};
+        uint32_t track = 0;
+        std::string name;
+    };
+
+public:
+    static Tracer &instance();
+
+    // all a trace point costs while tracing is off
+    static bool enabled() {
+        return tracing.load(std::memory_order_relaxed);
+    }
+
+    static void enable(bool on) {
+        tracing.store(on, std::memory_order_relaxed);
+    }
+
+    // names the track of the calling thread in the trace, "thread N" otherwise
+    static void name_current_thread(const std::string &name);
+
+    void record(TraceEventKind kind, const void *object, uint32_t task_id, uint32_t detail = 0) {
+        TraceEvent event{Clock::now(), object, task_id, detail, kind};
+
+        if (!this->local_buffer()->ring.push(event))
+            this->dropped_events.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // events recorded while it runs are left for the next call
+    void write_chrome_trace(std::ostream &out);
+
+    [[nodiscard]] uint64_t get_dropped_events() const {
+        return this->dropped_events.load(std::memory_order_relaxed);
+    }
+
+public:
+    Tracer(Tracer const &other) = delete;
+
+    Tracer &operator=(Tracer const &rhs) = delete;
+
+private:
+    Tracer() = default;
+
+    ThreadBuffer *local_buffer();
+
+    ThreadBuffer *acquire_buffer();
+
+private:
+    inline static std::atomic<bool> tracing{false};
+
+    rw_lock buffers_lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    std::mutex drain_lock;
+
+    std::atomic<uint64_t> dropped_events{0};
+};
+
+#define TRACE_EVENT(kind, ...)                                          \
+    do {                                                                \
+        if (Tracer::enabled())                                          \
+            Tracer::instance().record(TraceEventKind::kind, __VA_ARGS__); \
+    } while (0)
+
+#endif //LAB2_TRACER_H